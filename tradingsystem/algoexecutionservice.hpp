@@ -9,6 +9,7 @@
 
 #include <string>
 #include "soa.hpp"
+#include "objectpool.hpp"
 #include "marketdataservice.hpp"
 #include "pricingservice.hpp"
 
@@ -26,10 +27,11 @@ class ExecutionOrder
 public:
 
     ExecutionOrder() = default;// ctor for an order
-    ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder)
+    ExecutionOrder(ProductHandle<T> _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder)
             : product(_product), side(_side), orderId(_orderId), orderType(_orderType), price(_price), visibleQuantity(_visibleQuantity), hiddenQuantity(_hiddenQuantity), parentOrderId(_parentOrderId), isChildOrder(_isChildOrder)
     {}
-    const T& GetProduct() const { return product; } // Get the product
+    const T& GetProduct() const { return product.Get(); } // Get the product
+    ProductHandle<T> GetProductHandle() const { return product; } // Get the handle onto the registered product
     PricingSide GetPricingSide() const { return side; } // Get the pricing side
     const string& GetOrderId() const { return orderId; } // Get the order ID
     OrderType GetOrderType() const { return orderType; } // Get the order type on this order
@@ -50,7 +52,7 @@ public:
         vector<string> strings;
         strings.reserve(9);  // Preallocate space for 9 elements
 
-        strings.push_back(product.GetProductId());
+        strings.push_back(product.Get().GetProductId());
         strings.push_back(sideToString.at(side));
         strings.push_back(orderId);
         strings.push_back(orderTypeToString.at(orderType));
@@ -62,8 +64,32 @@ public:
 
         return strings;
     } // Change attributes to strings
+    void WriteTo(RecordBuffer& _buffer) const
+    {
+        _buffer.WriteField(product.Get().GetProductId());
+        _buffer.WriteField(side == BID ? "BID" : "OFFER");
+        _buffer.WriteField(orderId);
+        _buffer.WriteField(OrderTypeToString(orderType));
+        _buffer.WritePrice(price);
+        _buffer.WriteInteger(visibleQuantity);
+        _buffer.WriteInteger(hiddenQuantity);
+        _buffer.WriteField(parentOrderId);
+        _buffer.WriteField(isChildOrder ? "YES" : "NO");
+    } // Write the fields ToStrings() returns into _buffer
 private:
-    T product;
+    static const char* OrderTypeToString(OrderType _orderType)
+    {
+        switch (_orderType)
+        {
+            case FOK: return "FOK";
+            case IOC: return "IOC";
+            case MARKET: return "MARKET";
+            case LIMIT: return "LIMIT";
+            case STOP: return "STOP";
+            default: return "";
+        }
+    } // Get the name of an order type
+    ProductHandle<T> product;
     PricingSide side;
     string orderId;
     OrderType orderType;
@@ -76,6 +102,7 @@ private:
 
 /**
 * An algo execution that process algo execution.
+* Move-only: it owns an execution order taken from a pool, which goes back to the pool when the algo execution is destroyed or replaced.
 * Type T is the product type.
 */
 template<typename T>
@@ -83,16 +110,15 @@ class AlgoExecution
 {
 public:
     AlgoExecution() = default; // Constructor
-    AlgoExecution(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder)
-    {
-        executionOrder = new ExecutionOrder<T>(_product, _side, _orderId, _orderType, _price, _visibleQuantity, _hiddenQuantity, _parentOrderId, _isChildOrder);
-    }
+    AlgoExecution(ObjectPool<ExecutionOrder<T>>& _pool, ProductHandle<T> _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder)
+        : executionOrder(_pool.Make(_product, _side, _orderId, _orderType, _price, _visibleQuantity, _hiddenQuantity, _parentOrderId, _isChildOrder))
+    {}
     ExecutionOrder<T>* GetExecutionOrder() const
     {
-        return executionOrder;
+        return executionOrder.get();
     } // Get the order
 private:
-    ExecutionOrder<T>* executionOrder;
+    PooledPtr<ExecutionOrder<T>> executionOrder;
 };
 
 template<typename T>
@@ -107,29 +133,34 @@ template<typename T>
 class AlgoExecutionService : public Service<string, AlgoExecution<T>>
 {
 private:
-    map<string, AlgoExecution<T>> algoExecutions;
+    ObjectPool<ExecutionOrder<T>> executionOrderPool; // declared before algoExecutions, which return their orders to it
+    ProductTable<T, AlgoExecution<T>> algoExecutions;
     vector<ServiceListener<AlgoExecution<T>>*> listeners;
     AlgoExecutionListenerFromMarketData<T>* listener;
     double spread;
-    long count;
+    ProductTable<T, long> counts; // product index -> orders executed, which alternates the side
 public:
     AlgoExecutionService()
     {
-        algoExecutions = map<string, AlgoExecution<T>>();
         listeners = vector<ServiceListener<AlgoExecution<T>>*>();
         listener = new AlgoExecutionListenerFromMarketData<T>(this);
         spread = 1.0 / 128.0;
-        count = 0;
     }  // Constructor
     ~AlgoExecutionService() {} // Destructor
     AlgoExecution<T>& GetData(string _key)
     {
-        return algoExecutions[_key];
+        return algoExecutions.At(_key);
     } // Get data on our service given a key
     void OnMessage(AlgoExecution<T>& _data)
     {
-        algoExecutions[_data.GetExecutionOrder()->GetProduct().GetProductId()] = _data;
-    } // The callback that a Connector should invoke for any new or updated data
+        const ExecutionOrder<T>& _order = *_data.GetExecutionOrder();
+        algoExecutions[_order.GetProductHandle()] = AlgoExecution<T>(executionOrderPool, _order.GetProductHandle(), _order.GetPricingSide(), _order.GetOrderId(), _order.GetOrderType(),
+                                                                     _order.GetPrice(), _order.GetVisibleQuantity(), _order.GetHiddenQuantity(), _order.GetParentOrderId(), _order.IsChildOrder());
+    } // The callback that a Connector should invoke for any new or updated data; _data is left as it was, so its order is copied into the pool
+    void OnMessage(AlgoExecution<T>&& _data)
+    {
+        algoExecutions[_data.GetExecutionOrder()->GetProductHandle()] = std::move(_data);
+    } // The callback for an algo execution handed over to the service, which takes ownership of it
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
     void AddListener(ServiceListener<AlgoExecution<T>>* _listener)
     {
@@ -145,15 +176,21 @@ public:
     {
         return listener;
     }
+    // Get the pool of execution orders
+    const ObjectPool<ExecutionOrder<T>>& GetPool() const
+    {
+        return executionOrderPool;
+    }
     // Publish algo streams (called by algo streaming service listener to subscribe data from pricing service)
     void AlgoExecuteOrder(OrderBook<T>& _orderBook)
     {
-        T _product = _orderBook.GetProduct();
-        string _productId = _product.GetProductId();
-        PricingSide _side;
+        // a side with no levels (e.g. all removed by deltas) has no price to cross the spread against
+        if (!_orderBook.IsTwoSided()) return;
+        ProductHandle<T> _product = _orderBook.GetProductHandle();
+        PricingSide _side = BID;
         string _orderId = GenerateId();
-        double _price;
-        long _quantity;
+        double _price = 0;
+        long _quantity = 0;
 
         BidOffer _bidOffer = _orderBook.GetBidOffer();
 
@@ -169,7 +206,8 @@ public:
 //        cout << _offerPrice << _bidPrice << endl;
         if (_offerPrice - _bidPrice <= spread)
         {
-            switch (count % 2)
+            long& _count = counts[_product];
+            switch (_count % 2)
             {
                 case 0:
                     _price = _bidPrice;
@@ -182,9 +220,10 @@ public:
                     _side = OFFER;
                     break;
             }
-            count++;
-            AlgoExecution<T> _algoExecution(_product, _side, _orderId, MARKET, _price, _quantity, 0, "", false);
-            algoExecutions[_productId] = _algoExecution;
+            _count++;
+            // replacing the product's last execution recycles its order
+            AlgoExecution<T>& _algoExecution = algoExecutions[_product];
+            _algoExecution = AlgoExecution<T>(executionOrderPool, _product, _side, _orderId, MARKET, _price, _quantity, 0, "", false);
 
 
             for (auto& l : listeners)
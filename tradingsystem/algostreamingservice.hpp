@@ -9,7 +9,9 @@
 
 #include <string>
 #include "soa.hpp"
+#include "objectpool.hpp"
 #include "pricingservice.hpp"
+#include "marketdataservice.hpp"
 
 /**
 * A price stream order with price and quantity (visible and hidden)
@@ -44,6 +46,12 @@ public:
         string _price = ConvertPrice(price);
         return vector<string>{_price, to_string(visibleQuantity), to_string(hiddenQuantity)};
     }
+	// Write the fields ToStrings() returns into _buffer
+	void WriteTo(RecordBuffer& _buffer) const{
+        _buffer.WritePrice(price);
+        _buffer.WriteInteger(visibleQuantity);
+        _buffer.WriteInteger(hiddenQuantity);
+    }
 private:
 	double price;
 	long visibleQuantity;
@@ -61,10 +69,12 @@ class PriceStream{
 public:
     // Constructor
     PriceStream() = default;
-    PriceStream(const T& _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder)
+    PriceStream(ProductHandle<T> _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder)
             : product(_product), bidOrder(_bidOrder), offerOrder(_offerOrder) {}
     // Get the product
-    const T& GetProduct() const { return product; }
+    const T& GetProduct() const { return product.Get(); }
+    // Get the handle onto the registered product
+    ProductHandle<T> GetProductHandle() const { return product; }
     // Get the bid order
     const PriceStreamOrder& GetBidOrder() const { return bidOrder; }
     // Get the offer order
@@ -72,7 +82,7 @@ public:
     // Change attributes to strings
     vector<string> ToStrings() const
     {
-        string _product = product.GetProductId();
+        string _product = product.Get().GetProductId();
         vector<string> _bidOrder = bidOrder.ToStrings();
         vector<string> _offerOrder = offerOrder.ToStrings();
 
@@ -82,9 +92,16 @@ public:
         _strings.insert(_strings.end(), _offerOrder.begin(), _offerOrder.end());
         return _strings;
     }
+    // Write the fields ToStrings() returns into _buffer
+    void WriteTo(RecordBuffer& _buffer) const
+    {
+        _buffer.WriteField(product.Get().GetProductId());
+        bidOrder.WriteTo(_buffer);
+        offerOrder.WriteTo(_buffer);
+    }
 
 private:
-    T product;
+    ProductHandle<T> product;
     PriceStreamOrder bidOrder;
     PriceStreamOrder offerOrder;
 };
@@ -92,6 +109,7 @@ private:
 
 /**
 * An algo streaming that process algo streaming.
+* Move-only: it owns a price stream taken from a pool, which goes back to the pool when the algo stream is destroyed or replaced.
 * Type T is the product type.
 */
 template<typename T>
@@ -100,14 +118,13 @@ class AlgoStream
 public:
     // Constructor
     AlgoStream() = default;
-    AlgoStream(const T& _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder)
-    {
-        priceStream = new PriceStream<T>(_product, _bidOrder, _offerOrder);
-    }
+    AlgoStream(ObjectPool<PriceStream<T>>& _pool, ProductHandle<T> _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder)
+        : priceStream(_pool.Make(_product, _bidOrder, _offerOrder))
+    {}
     // Get the order
-    PriceStream<T>* GetPriceStream() const { return priceStream; }
+    PriceStream<T>* GetPriceStream() const { return priceStream.get(); }
 private:
-    PriceStream<T>* priceStream;
+    PooledPtr<PriceStream<T>> priceStream;
 };
 
 /**
@@ -124,16 +141,16 @@ template<typename T>
 class AlgoStreamingService : public Service<string, AlgoStream<T>>
 {
 private:
-    map<string, AlgoStream<T>> algoStreams;
+    ObjectPool<PriceStream<T>> priceStreamPool; // declared before algoStreams, which return their price streams to it
+    ProductTable<T, AlgoStream<T>> algoStreams;
     vector<ServiceListener<AlgoStream<T>>*> listeners;
-    ServiceListener<Price<T>>* listener;
-    long count;
+    AlgoStreamingToPricingListener<T>* listener;
+    ProductTable<T, long> counts; // product index -> prices streamed, which alternates the quantities
 
 public:
     // Constructor
-    AlgoStreamingService() : count(0)
+    AlgoStreamingService()
     {
-        algoStreams = map<string, AlgoStream<T>>();
         listeners = vector<ServiceListener<AlgoStream<T>>*>();
         listener = new AlgoStreamingToPricingListener<T>(this);
     }
@@ -142,12 +159,18 @@ public:
     // Get data on our service given a key
     AlgoStream<T>& GetData(string _key)
     {
-        return algoStreams[_key];
+        return algoStreams.At(_key);
     }
-    // The callback that a Connector should invoke for any new or updated data
+    // The callback that a Connector should invoke for any new or updated data; _data is left as it was, so its price stream is copied into the pool
     void OnMessage(AlgoStream<T>& _data)
     {
-        algoStreams[_data.GetPriceStream()->GetProduct().GetProductId()] = _data;
+        const PriceStream<T>& _stream = *_data.GetPriceStream();
+        algoStreams[_stream.GetProductHandle()] = AlgoStream<T>(priceStreamPool, _stream.GetProductHandle(), _stream.GetBidOrder(), _stream.GetOfferOrder());
+    }
+    // The callback for an algo stream handed over to the service, which takes ownership of it
+    void OnMessage(AlgoStream<T>&& _data)
+    {
+        algoStreams[_data.GetPriceStream()->GetProductHandle()] = std::move(_data);
     }
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
     void AddListener(ServiceListener<AlgoStream<T>>* _listener)
@@ -160,34 +183,42 @@ public:
         return listeners;
     }
     // Get the listener of the service
-    ServiceListener<Price<T>>* GetListener()
+    AlgoStreamingToPricingListener<T>* GetListener()
     {
         return listener;
     }
     // Publish two-way prices
     void AlgoPublishPrice(Price<T>& _price)
     {
-        T _product = _price.GetProduct();
-        string _productId = _product.GetProductId();
+        VirtualListeners<AlgoStream<T>> _sink(listeners);
+        AlgoPublishPrice(_price, _sink);
+    }
+    // Publish two-way prices to a compile-time sink
+    template<typename Sink>
+    void AlgoPublishPrice(Price<T>& _price, Sink& _sink)
+    {
+        ProductHandle<T> _product = _price.GetProductHandle();
 
         double _mid = _price.GetMid();
         double _bidOfferSpread = _price.GetBidOfferSpread();
         double _bidPrice = _mid - _bidOfferSpread / 2.0;
         double _offerPrice = _mid + _bidOfferSpread / 2.0;
-        long _visibleQuantity = (count % 2 + 1) * 10000000;
+        long& _count = counts[_product];
+        long _visibleQuantity = (_count % 2 + 1) * 10000000;
         long _hiddenQuantity = _visibleQuantity * 2;
 
-        count++;
+        _count++;
         PriceStreamOrder _bidOrder(_bidPrice, _visibleQuantity, _hiddenQuantity, BID);
         PriceStreamOrder _offerOrder(_offerPrice, _visibleQuantity, _hiddenQuantity, OFFER);
-        AlgoStream<T> _algoStream(_product, _bidOrder, _offerOrder);
-        algoStreams[_productId] = _algoStream;
-
-
-        for (auto& l : listeners)
-        {
-            l->ProcessAdd(_algoStream);
-        }
+        // replacing the product's last stream recycles its price stream
+        AlgoStream<T>& _algoStream = algoStreams[_product];
+        _algoStream = AlgoStream<T>(priceStreamPool, _product, _bidOrder, _offerOrder);
+        _sink.ProcessAdd(_algoStream);
+    }
+    // Get the pool of price streams
+    const ObjectPool<PriceStream<T>>& GetPool() const
+    {
+        return priceStreamPool;
     }
 };
 
@@ -196,7 +227,7 @@ public:
 * Type T is the product type.
 */
 template<typename T>
-class AlgoStreamingToPricingListener : public ServiceListener<Price<T>>
+class AlgoStreamingToPricingListener final : public ServiceListener<Price<T>>
 {
 private:
     AlgoStreamingService<T>* service;
@@ -214,6 +245,13 @@ public:
         service->AlgoPublishPrice(_data);
     }
 
+    // Listener callback to process an add event, publishing to a compile-time sink
+    template<typename Sink>
+    void ProcessAdd(Price<T>& _data, Sink& _sink)
+    {
+        service->AlgoPublishPrice(_data, _sink);
+    }
+
     // Listener callback to process a remove event to the Service
     void ProcessRemove(Price<T>& _data)
     {
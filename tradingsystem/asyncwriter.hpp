@@ -0,0 +1,151 @@
+/**
+* asyncwriter.hpp
+* Defines a buffered file writer that persists on a background thread.
+*
+*/
+#ifndef ASYNC_WRITER_HPP
+#define ASYNC_WRITER_HPP
+
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace chrono;
+
+/**
+* How much an AsyncFileWriter buffers and when it writes the buffer out.
+*/
+struct FlushPolicy{
+	size_t capacity = 1 << 20;                          // bytes buffered before Append() waits, at least flushBytes
+	size_t flushBytes = 1 << 16;                        // bytes that wake the writer
+	milliseconds flushInterval = milliseconds(100);     // longest a record waits to be written, at least 1ms
+};
+
+/**
+* Appends bytes to a file through a persistent handle.
+* Callers copy records into a bounded in-memory buffer and return immediately; a background
+* thread writes the buffer out whenever it holds flushBytes, every flushInterval, or on Flush().
+* When the buffer is full, Append() waits for the writer to catch up instead of growing without bound.
+* A failed write is remembered and reported by the next Flush() or Sync() rather than counted as written.
+*/
+class AsyncFileWriter{
+public:
+	// ctor opening _path for append, buffering and flushing as _policy says
+	explicit AsyncFileWriter(const string& _path, const FlushPolicy& _policy = FlushPolicy())
+        : path(_path), capacity(max(_policy.capacity, _policy.flushBytes)), flushBytes(_policy.flushBytes),
+          flushInterval(max(_policy.flushInterval, milliseconds(1))), appended(0), written(0), lost(0), error(0), stopping(false){
+        fd = open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) throw runtime_error("Cannot open " + _path);
+        active.reserve(capacity);
+        writing.reserve(capacity);
+        worker = thread(&AsyncFileWriter::Run, this);
+    }
+	// dtor writing out everything appended so far
+	~AsyncFileWriter(){
+        {
+            lock_guard<mutex> _lock(guard);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        close(fd);
+    }
+	AsyncFileWriter(const AsyncFileWriter&) = delete;
+	AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+	// Append bytes to the file, waiting only if the buffer is full
+	void Append(const char* _data, size_t _size){
+        unique_lock<mutex> _lock(guard);
+        space.wait(_lock, [&]() { return active.empty() || active.size() + _size <= capacity; });
+        active.append(_data, _size);
+        appended += _size;
+        if (active.size() >= flushBytes) wake.notify_one();
+    }
+	void Append(const string& _data){
+        Append(_data.data(), _data.size());
+    }
+	// Wait until everything appended before the call has been written to the file; throws if any write has failed
+	void Flush(){
+        unique_lock<mutex> _lock(guard);
+        size_t _target = appended;
+        flushTarget = max(flushTarget, _target);
+        wake.notify_one();
+        done.wait(_lock, [&]() { return written + lost >= _target; });
+        if (error != 0) throw runtime_error("Cannot write " + path + ": " + strerror(error) + " (" + to_string(lost) + " bytes lost)");
+    }
+	// Durability barrier: Flush() and then wait until the file is on stable storage
+	void Sync(){
+        Flush();
+        if (fsync(fd) != 0) throw runtime_error("Cannot sync " + path + ": " + strerror(errno));
+    }
+private:
+	// Background loop: swap out the buffer and write it without holding the lock
+	void Run(){
+        unique_lock<mutex> _lock(guard);
+        while (true){
+            wake.wait_for(_lock, flushInterval, [&]() {
+                return stopping || active.size() >= flushBytes || flushTarget > written + lost;
+            });
+            if (active.empty()){
+                if (stopping) return;
+                continue;
+            }
+
+            swap(active, writing);
+            space.notify_all();
+            _lock.unlock();
+
+            const char* _p = writing.data();
+            size_t _left = writing.size();
+            int _error = 0;
+            while (_left > 0){
+                ssize_t _n = write(fd, _p, _left);
+                if (_n < 0 && errno == EINTR) continue;
+                if (_n <= 0){
+                    _error = _n < 0 ? errno : EIO;
+                    break;
+                }
+                _p += _n;
+                _left -= _n;
+            }
+            size_t _size = writing.size();
+            writing.clear();
+
+            _lock.lock();
+            written += _size - _left;
+            lost += _left;
+            if (_error != 0 && error == 0) error = _error;
+            done.notify_all();
+        }
+    }
+
+	int fd;
+	string path;
+	size_t capacity;
+	size_t flushBytes;
+	milliseconds flushInterval;
+	string active;      // filled by callers
+	string writing;     // being written by the background thread
+	size_t appended;    // total bytes appended
+	size_t written;     // total bytes written
+	size_t lost;        // total bytes dropped by failed writes
+	int error;          // errno of the first failed write, 0 if none
+	size_t flushTarget = 0;
+	bool stopping;
+	mutex guard;
+	condition_variable wake;
+	condition_variable space;
+	condition_variable done;
+	thread worker;
+};
+
+#endif
@@ -0,0 +1,475 @@
+/**
+* backpressure.hpp
+* Defines a bounded asynchronous edge between two Services. The upstream Service publishes into the
+* edge as it would into any listener and returns; a worker thread forwards the events downstream.
+* What happens when the downstream side falls behind and the queue fills up is chosen per edge,
+* and every edge reports its queue depth and overflow counters while it runs.
+*
+*/
+#ifndef BACKPRESSURE_HPP
+#define BACKPRESSURE_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits>
+#include <stdexcept>
+#include <cstdio>
+#include <unistd.h>
+#include "soa.hpp"
+#include "journal.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+// What an edge does with an event that arrives while its queue is full
+enum EdgePolicy {
+    BLOCK,          // the producer waits for room
+    DROP_OLDEST,    // the oldest queued event is discarded
+    CONFLATE,       // a queued event for the same key is replaced; an event for a new key waits for room
+    SPILL           // the event is written to a temporary file and read back in order
+};
+
+// Get the name of an edge policy
+const char* EdgePolicyName(EdgePolicy _policy)
+{
+	switch (_policy)
+	{
+	case BLOCK: return "block";
+	case DROP_OLDEST: return "drop-oldest";
+	case CONFLATE: return "conflate";
+	case SPILL: return "spill";
+	}
+	return "";
+}
+
+// Events an edge forwards downstream in one batch
+const size_t EDGE_BATCH_SIZE = 256;
+
+/**
+* Snapshot of an edge's queue and counters.
+*/
+struct EdgeStats{
+	string name;
+	EdgePolicy policy;
+	size_t capacity;
+	size_t depth;           // events queued in memory
+	size_t spillDepth;      // events waiting in the spill file
+	size_t highWater;       // largest depth seen
+	long received;
+	long delivered;
+	long dropped;           // DROP_OLDEST: events discarded
+	long conflated;         // CONFLATE: events replaced while queued
+	long spilled;           // SPILL: events written to the spill file
+	long blocked;           // times the producer waited for room
+	long spillFailures;     // SPILL: failed writes or reads of the spill file
+	long lost;              // SPILL: spilled events that could not be read back
+};
+
+/**
+* An edge whose counters can be read while it runs.
+*/
+class MonitoredEdge{
+public:
+	virtual ~MonitoredEdge() = default;
+	// Get a snapshot of the edge's counters
+	virtual EdgeStats GetStats() = 0;
+};
+
+/**
+* Registry of the live edges, for reporting their counters at runtime.
+*/
+class EdgeMonitor{
+public:
+	// Get the edge monitor
+	static EdgeMonitor& Instance(){
+        static EdgeMonitor _monitor;
+        return _monitor;
+    }
+	EdgeMonitor(const EdgeMonitor&) = delete;
+	EdgeMonitor& operator=(const EdgeMonitor&) = delete;
+
+	void Add(MonitoredEdge* _edge){
+        lock_guard<mutex> _lock(guard);
+        edges.push_back(_edge);
+    }
+	void Remove(MonitoredEdge* _edge){
+        lock_guard<mutex> _lock(guard);
+        edges.erase(remove(edges.begin(), edges.end(), _edge), edges.end());
+    }
+	// Get a snapshot of every live edge
+	vector<EdgeStats> GetStats(){
+        lock_guard<mutex> _lock(guard);
+        vector<EdgeStats> _stats;
+        for (auto& e : edges) _stats.push_back(e->GetStats());
+        return _stats;
+    }
+	// Log one line per live edge
+	void Report(){
+        for (auto& s : GetStats()){
+            Logger::Instance().Log(LogLevel::INFO, "Edge {} ({}): depth {}, high water {} of {}, {} spilled waiting",
+                                   s.name, EdgePolicyName(s.policy), s.depth, s.highWater, s.capacity, s.spillDepth);
+            Logger::Instance().Log(LogLevel::INFO, "Edge {}: {} received, {} delivered, {} dropped, {} conflated, {} spilled",
+                                   s.name, s.received, s.delivered, s.dropped, s.conflated, s.spilled);
+            if (s.spillFailures > 0)
+                Logger::Instance().Log(LogLevel::ERROR, "Edge {}: spill file failed {} times, {} spilled events lost; blocking instead of spilling",
+                                       s.name, s.spillFailures, s.lost);
+        }
+    }
+private:
+	EdgeMonitor() = default;
+
+	mutex guard;
+	vector<MonitoredEdge*> edges;
+};
+
+// Whether data type V has a JournalCodec, and so can be spilled to disk
+template<typename V, typename = void>
+struct IsSpillable : false_type {};
+template<typename V>
+struct IsSpillable<V, void_t<typename JournalCodec<V>::Record>> : true_type {};
+
+// Decoder of spilled events of data type V
+template<typename V, bool = IsSpillable<V>::value>
+struct SpillDecoder { typedef char type; };
+template<typename V>
+struct SpillDecoder<V, true> { typedef JournalDecoder<V> type; };
+
+// Bytes read back from a spill file at a time, grown if one event does not fit
+const size_t SPILL_READ_SIZE = 64 * 1024;
+
+/**
+* Bounded asynchronous edge between two Services.
+* Registered as a listener on the upstream Service, it queues each event and returns; its own thread
+* forwards the events to the downstream listener, as the adds or updates they arrived as, in the order they were queued. The queue holds at most
+* _capacity events, and the policy decides what happens to an event arriving while it is full (see EdgePolicy).
+* Crossing into the full state logs a warning once, until the queue has drained back below half.
+* If the spill file cannot be written or read back, the edge counts the failure and blocks from then on, as BLOCK does;
+* events already spilled that cannot be read back are counted as lost. Nothing is thrown on either thread.
+* SPILL needs a JournalCodec for V; CONFLATE needs KeyOf to map V to a small dense index, and queues events
+* in a ConflationQueue (the same one a ConflatingListener keeps) instead of the ring.
+* Events are copied into the queue, so V must own its data: a store view such as Position does not compile here.
+* Type V is the data type.
+*/
+template<typename V, typename KeyOf = ProductIndexOf>
+class BoundedEdge final : public ServiceListener<V>, public MonitoredEdge{
+	static_assert(!IsStoreView<V>::value, "an edge delivers copies of its events later, which a view does not own");
+public:
+	// ctor starting the thread forwarding to _downstream
+	BoundedEdge(const string& _name, ServiceListener<V>* _downstream, EdgePolicy _policy, size_t _capacity = 4096)
+        : name(_name), downstream(_downstream), policy(_policy), capacity(max<size_t>(_capacity, 1)), slots(policy == CONFLATE ? 0 : capacity),
+          head(0), depth(0), spillFile(nullptr), spillWritten(0), spillRead(0), spillFileEvents(0), spillBuffered(0),
+          spillBatchEvents(0), highWater(0),
+          received(0), delivered(0), dropped(0), conflated(0), spilled(0), blocked(0), spillFailures(0), lost(0),
+          spillFailed(false), overloaded(false), closed(false){
+        if constexpr (!IsSpillable<V>::value){
+            if (policy == SPILL) throw invalid_argument("edge " + name + ": data type cannot be spilled");
+        }
+        if constexpr (!is_invocable<KeyOf, const V&>::value){
+            if (policy == CONFLATE) throw invalid_argument("edge " + name + ": data type has no conflation key");
+        }
+        if (policy == SPILL){
+            spillFile = tmpfile();
+            if (!spillFile) throw runtime_error("edge " + name + ": cannot create spill file");
+        }
+        EdgeMonitor::Instance().Add(this);
+        worker = thread(&BoundedEdge::Run, this);
+    }
+	// dtor forwarding everything still queued
+	~BoundedEdge(){
+        Close();
+        EdgeMonitor::Instance().Remove(this);
+        if (spillFile) fclose(spillFile);
+    }
+	BoundedEdge(const BoundedEdge&) = delete;
+	BoundedEdge& operator=(const BoundedEdge&) = delete;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(V& _data) override { Offer(_data, false); }
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(V& _data) override {}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(V& _data) override { Offer(_data, true); }
+
+	// Mark the end of the stream and wait until every queued event has been forwarded
+	void Close(){
+        {
+            lock_guard<mutex> _lock(guard);
+            if (closed && !worker.joinable()) return;
+            closed = true;
+        }
+        ready.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+	// Whether the queue is full, so the policy is being applied to new events
+	bool IsOverloaded(){
+        lock_guard<mutex> _lock(guard);
+        return overloaded;
+    }
+
+	// Get a snapshot of the edge's counters
+	EdgeStats GetStats() override{
+        lock_guard<mutex> _lock(guard);
+        return EdgeStats{ name, policy, capacity, depth, SpillDepth(), highWater, received, delivered, dropped, conflated, spilled, blocked,
+                          spillFailures, lost };
+    }
+
+private:
+	// A queued event and whether it was an update rather than an add
+	typedef typename ConflationQueue<V, KeyOf>::Event Event;
+
+	void Offer(const V& _data, bool _isUpdate){
+        unique_lock<mutex> _lock(guard);
+        received++;
+        if (policy == CONFLATE){
+            Conflate(_data, _isUpdate, _lock);
+            return;
+        }
+        if (policy == SPILL && !spillFailed && (depth == capacity || SpillDepth() > 0)){
+            // once anything is spilled, later events follow it to the file so the order is kept
+            Spill(_data, _isUpdate);
+            SignalOverload();
+            return;
+        }
+        if (spillFailed && (depth == capacity || SpillDepth() > 0)){
+            // the spill file has failed: wait for room, behind whatever is still spilled so the order is kept
+            SignalOverload();
+            blocked++;
+            space.wait(_lock, [&]() { return depth < capacity && SpillDepth() == 0; });
+        }
+        if (depth == capacity){
+            SignalOverload();
+            if (policy == DROP_OLDEST){
+                PopFront();
+                dropped++;
+            }
+            else{
+                blocked++;
+                space.wait(_lock, [&]() { return depth < capacity; });
+            }
+        }
+        PushBack(_data, _isUpdate);
+        if (depth == 1) ready.notify_one();
+    }
+
+	// CONFLATE: overwrite the queued event for the same key, or else queue the event once there is room
+	void Conflate(const V& _data, bool _isUpdate, unique_lock<mutex>& _lock){
+        if constexpr (is_invocable<KeyOf, const V&>::value){
+            // another producer may queue the key while this one waits, so look again after every wait
+            while (!conflation.Replace(_data, _isUpdate)){
+                if (depth < capacity){
+                    conflation.Push(_data, _isUpdate);
+                    depth++;
+                    highWater = max(highWater, depth);
+                    if (depth == 1) ready.notify_one();
+                    return;
+                }
+                SignalOverload();
+                blocked++;
+                space.wait(_lock, [&]() { return depth < capacity; });
+            }
+            conflated++;
+        }
+    }
+
+	void PushBack(const V& _data, bool _isUpdate){
+        slots[(head + depth) % capacity] = Event{ _data, _isUpdate };
+        depth++;
+        highWater = max(highWater, depth);
+    }
+	void PopFront(){
+        head = (head + 1) % capacity;
+        depth--;
+    }
+
+	// Warn the first time the queue fills up, until it drains back below half
+	void SignalOverload(){
+        if (overloaded) return;
+        overloaded = true;
+        Logger::Instance().Log(LogLevel::WARNING, "Edge {} is full at {} events: applying the {} policy", name, capacity,
+                               EdgePolicyName(spillFailed ? BLOCK : policy));
+    }
+
+	size_t SpillDepth() const{
+        return spillFileEvents + spillBuffered;
+    }
+
+	// SPILL: append an event to the spill file, a batch of EDGE_BATCH_SIZE at a time.
+	// A spilled event is one byte saying whether it was an update, then its journal record.
+	// If the batch cannot be written it stays buffered, to be forwarded after the file, and spilling stops.
+	void Spill(const V& _data, bool _isUpdate){
+        if constexpr (IsSpillable<V>::value){
+            spillBuffer.Append(static_cast<char>(_isUpdate));
+            AppendJournalRecord(_data, JournalTimestamp(), spillBuffer);
+            spillBuffered++;
+            spilled++;
+            if (spillBuffered < EDGE_BATCH_SIZE) return;
+            size_t _bytes = spillBuffer.Size();
+            if (pwrite(fileno(spillFile), spillBuffer.Data(), _bytes, spillWritten) != static_cast<ssize_t>(_bytes)){
+                FailSpill("cannot write spill file");
+                return;
+            }
+            spillWritten += _bytes;
+            spillFileEvents += spillBuffered;
+            spillBuffer.Clear();
+            spillBuffered = 0;
+        }
+    }
+
+	// SPILL: read back up to EDGE_BATCH_SIZE spilled events; called with the lock held once the memory queue is empty.
+	// If the file cannot be read back, the events left in it are counted as lost and the buffered ones are taken instead.
+	void Unspill(){
+        if constexpr (IsSpillable<V>::value){
+            if (spillFileEvents == 0){
+                // the file has been read back, so what is left has not been written out yet
+                spillBatch.assign(spillBuffer.Data(), spillBuffer.Size());
+                spillBatchEvents = spillBuffered;
+                spillBuffer.Clear();
+                spillBuffered = 0;
+                return;
+            }
+            size_t _available = spillWritten - spillRead;
+            size_t _chunk = min(_available, SPILL_READ_SIZE);
+            size_t _bytes = 0;
+            spillBatchEvents = 0;
+            while (true){
+                spillBatch.resize(_chunk);
+                if (pread(fileno(spillFile), &spillBatch[0], _chunk, spillRead) != static_cast<ssize_t>(_chunk)){
+                    LoseSpillFile("cannot read spill file");
+                    return;
+                }
+                // take the whole events the chunk holds
+                string_view _read(spillBatch);
+                while (spillBatchEvents < EDGE_BATCH_SIZE && _bytes < _read.size()){
+                    size_t _size = JournalRecordSize(_read.substr(_bytes + 1));
+                    if (_size == 0) break;
+                    _bytes += 1 + _size;
+                    spillBatchEvents++;
+                }
+                if (spillBatchEvents > 0) break;
+                if (_chunk == _available){
+                    LoseSpillFile("corrupt spill file");
+                    return;
+                }
+                _chunk = min(_available, _chunk * 2);
+            }
+            spillBatch.resize(_bytes);
+            spillRead += _bytes;
+            spillFileEvents -= spillBatchEvents;
+            // start the file over once it has been read back, so it only grows while the backlog does
+            if (spillRead == spillWritten) spillRead = spillWritten = 0;
+        }
+    }
+
+	// SPILL: count a failed write or read and stop spilling; logs an error the first time
+	void FailSpill(const char* _what){
+        spillFailures++;
+        if (!spillFailed)
+            Logger::Instance().Log(LogLevel::ERROR, "Edge {}: {}: blocking instead of spilling", name, _what);
+        spillFailed = true;
+    }
+	// SPILL: give up on the events left in the file after a failed read, then take the buffered ones
+	void LoseSpillFile(const char* _what){
+        FailSpill(_what);
+        lost += spillFileEvents;
+        spillFileEvents = 0;
+        spillRead = spillWritten = 0;
+        spillBatch.clear();
+        spillBatchEvents = 0;
+        Unspill();
+    }
+
+	// Background loop: take a batch from the memory queue, or else from the spill file, and forward it outside the lock
+	void Run(){
+        while (true){
+            {
+                unique_lock<mutex> _lock(guard);
+                ready.wait(_lock, [&]() { return closed || depth > 0 || SpillDepth() > 0; });
+                batch.clear();
+                spillBatch.clear();
+                spillBatchEvents = 0;
+                if (depth > 0 && policy == CONFLATE){
+                    conflation.Take(batch, EDGE_BATCH_SIZE);
+                    depth = conflation.Size();
+                }
+                else if (depth > 0){
+                    while (depth > 0 && batch.size() < EDGE_BATCH_SIZE){
+                        batch.push_back(slots[head]);
+                        PopFront();
+                    }
+                }
+                else if (SpillDepth() > 0){
+                    Unspill();
+                }
+                else{
+                    return;
+                }
+                if (overloaded && depth < capacity / 2 && SpillDepth() == 0) overloaded = false;
+            }
+            space.notify_all();
+
+            for (auto& e : batch) Forward(e.data, e.isUpdate);
+            if constexpr (IsSpillable<V>::value){
+                // decode one at a time: a decoded event may only be valid until the next Decode()
+                string_view _spilled(spillBatch);
+                while (!_spilled.empty()){
+                    bool _isUpdate = _spilled[0] != 0;
+                    size_t _size = JournalRecordSize(_spilled.substr(1));
+                    V _data = spillDecoder.Decode(_spilled.substr(1, _size));
+                    Forward(_data, _isUpdate);
+                    _spilled.remove_prefix(1 + _size);
+                }
+            }
+            lock_guard<mutex> _lock(guard);
+            delivered += batch.size() + spillBatchEvents;
+        }
+    }
+
+	void Forward(V& _data, bool _isUpdate){
+        if (_isUpdate) downstream->ProcessUpdate(_data);
+        else downstream->ProcessAdd(_data);
+    }
+
+	string name;
+	ServiceListener<V>* downstream;
+	EdgePolicy policy;
+	size_t capacity;
+	vector<Event> slots;            // ring of queued events
+	size_t head;                    // slot of the oldest queued event
+	size_t depth;                   // events queued
+	ConflationQueue<V, KeyOf> conflation;   // CONFLATE: the queued events, latest per key
+	FILE* spillFile;
+	size_t spillWritten;            // SPILL: bytes written to the spill file
+	size_t spillRead;               // SPILL: bytes read back
+	size_t spillFileEvents;         // SPILL: events in the file not read back yet
+	size_t spillBuffered;           // SPILL: events spilled but not yet written to the file
+	size_t spillBatchEvents;        // SPILL: events read back into spillBatch
+	vector<Event> batch;            // events being forwarded, owned by the worker
+	RecordBuffer spillBuffer;       // SPILL: bytes of the events not yet written to the file
+	string spillBatch;              // SPILL: bytes of the events read back, owned by the worker
+	typename SpillDecoder<V>::type spillDecoder;    // SPILL: decodes read-back events, owned by the worker
+	size_t highWater;
+	long received;
+	long delivered;
+	long dropped;
+	long conflated;
+	long spilled;
+	long blocked;
+	long spillFailures;
+	long lost;
+	bool spillFailed;               // SPILL: the spill file failed, so the edge blocks instead
+	bool overloaded;
+	bool closed;
+	mutex guard;
+	condition_variable ready;       // an event is queued or the edge is closed
+	condition_variable space;       // the queue has room
+	thread worker;
+};
+
+#endif
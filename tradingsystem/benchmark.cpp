@@ -0,0 +1,1415 @@
+/**
+* benchmark.cpp
+* Micro-benchmarks for the hot paths of the trading system.
+*
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+#include <array>
+#include <filesystem>
+#include <thread>
+
+#include "soa.hpp"
+#include "pricecodec.hpp"
+#include "mappedfile.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "streamingservice.hpp"
+#include "guiservice.hpp"
+#include "historicaldataservice.hpp"
+#include "marketdataservice.hpp"
+#include "pv01engine.hpp"
+#include "riskservice.hpp"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "executionservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "inquiryservice.hpp"
+#include "logger.hpp"
+#include "spscqueue.hpp"
+#include "backpressure.hpp"
+#include "shardedexecutor.hpp"
+
+using namespace std;
+
+// Count heap allocations, so a benchmark can report how many each operation makes.
+// Every form of the global operator new and delete is replaced, so each allocation is counted and released by the same pair.
+atomic<long> allocations(0);
+
+// Allocate _size bytes aligned to _alignment (0 for the default), counting the allocation; null on failure
+void* CountedAlloc(size_t _size, size_t _alignment = 0)
+{
+	allocations.fetch_add(1, memory_order_relaxed);
+	if (_size == 0) _size = 1;
+	if (_alignment == 0) return malloc(_size);
+	void* _p = nullptr;
+	return posix_memalign(&_p, max(_alignment, sizeof(void*)), _size) == 0 ? _p : nullptr;
+}
+
+// Release memory from CountedAlloc; out of line, so the compiler never pairs free() with a visible operator new
+__attribute__((noinline)) void CountedFree(void* _p) noexcept
+{
+	free(_p);
+}
+
+void* operator new(size_t _size)
+{
+	if (void* _p = CountedAlloc(_size)) return _p;
+	throw bad_alloc();
+}
+void* operator new[](size_t _size)
+{
+	if (void* _p = CountedAlloc(_size)) return _p;
+	throw bad_alloc();
+}
+void* operator new(size_t _size, align_val_t _alignment)
+{
+	if (void* _p = CountedAlloc(_size, static_cast<size_t>(_alignment))) return _p;
+	throw bad_alloc();
+}
+void* operator new[](size_t _size, align_val_t _alignment)
+{
+	if (void* _p = CountedAlloc(_size, static_cast<size_t>(_alignment))) return _p;
+	throw bad_alloc();
+}
+void* operator new(size_t _size, const nothrow_t&) noexcept { return CountedAlloc(_size); }
+void* operator new[](size_t _size, const nothrow_t&) noexcept { return CountedAlloc(_size); }
+void* operator new(size_t _size, align_val_t _alignment, const nothrow_t&) noexcept { return CountedAlloc(_size, static_cast<size_t>(_alignment)); }
+void* operator new[](size_t _size, align_val_t _alignment, const nothrow_t&) noexcept { return CountedAlloc(_size, static_cast<size_t>(_alignment)); }
+
+void operator delete(void* _p) noexcept { CountedFree(_p); }
+void operator delete[](void* _p) noexcept { CountedFree(_p); }
+void operator delete(void* _p, size_t) noexcept { CountedFree(_p); }
+void operator delete[](void* _p, size_t) noexcept { CountedFree(_p); }
+void operator delete(void* _p, align_val_t) noexcept { CountedFree(_p); }
+void operator delete[](void* _p, align_val_t) noexcept { CountedFree(_p); }
+void operator delete(void* _p, size_t, align_val_t) noexcept { CountedFree(_p); }
+void operator delete[](void* _p, size_t, align_val_t) noexcept { CountedFree(_p); }
+void operator delete(void* _p, const nothrow_t&) noexcept { CountedFree(_p); }
+void operator delete[](void* _p, const nothrow_t&) noexcept { CountedFree(_p); }
+void operator delete(void* _p, align_val_t, const nothrow_t&) noexcept { CountedFree(_p); }
+void operator delete[](void* _p, align_val_t, const nothrow_t&) noexcept { CountedFree(_p); }
+
+// Keep the compiler from optimizing away a value that is otherwise unused.
+template<typename V>
+void DoNotOptimize(const V& _value)
+{
+	asm volatile("" : : "r,m"(_value) : "memory");
+}
+
+// Time _iterations calls of _func and print the cost per call.
+template<typename F>
+void Benchmark(const string& _name, long _iterations, F _func)
+{
+	for (long i = 0; i < _iterations / 10; ++i) _func(i);
+
+	auto _start = steady_clock::now();
+	for (long i = 0; i < _iterations; ++i) _func(i);
+	double _nanoseconds = duration<double, nano>(steady_clock::now() - _start).count();
+
+	cout << left << setw(48) << _name << right << setw(12) << fixed << setprecision(2) << _nanoseconds / _iterations << " ns/op" << endl;
+}
+
+// Print mean and percentiles of per-event latencies in nanoseconds.
+void ReportLatency(const string& _name, vector<double>& _latencies)
+{
+	sort(_latencies.begin(), _latencies.end());
+	double _total = 0;
+	for (double l : _latencies) _total += l;
+	auto _percentile = [&](double p) { return _latencies[static_cast<size_t>(p * (_latencies.size() - 1))]; };
+
+	cout << left << setw(48) << _name << right << fixed << setprecision(1)
+	     << " mean " << setw(9) << _total / _latencies.size()
+	     << "  p50 " << setw(9) << _percentile(0.50)
+	     << "  p99 " << setw(9) << _percentile(0.99)
+	     << "  p99.9 " << setw(9) << _percentile(0.999) << " ns" << endl;
+}
+
+// Send the logger's output, which carries the connectors' console output, to /dev/null for the lifetime of the object,
+// so connectors that print do not dominate a measurement. What was queued meanwhile is discarded on the way out.
+class SilenceConsole
+{
+public:
+	SilenceConsole() : null(fopen("/dev/null", "w")) { Logger::Instance().SetOutput(null); }
+	~SilenceConsole() { Logger::Instance().SetOutput(stdout); fclose(null); }
+private:
+	FILE* null;
+};
+
+// A terminal listener that only counts events, to measure dispatch without any I/O.
+template<typename V>
+class CountingListener final : public ServiceListener<V>
+{
+public:
+	void ProcessAdd(V& _data) override { ++count; }
+	void ProcessRemove(V& _data) override {}
+	void ProcessUpdate(V& _data) override {}
+	long count = 0;
+};
+
+// Parse prices.txt once so a replay measures only the service graph.
+vector<Price<Bond>> LoadPrices(const string& _path)
+{
+	vector<Price<Bond>> _prices;
+	MappedFile _file(_path);
+	string_view _text = _file.View();
+	while (!_text.empty())
+	{
+		string_view _line = NextToken(_text, '\n');
+		if (_line.empty()) continue;
+		ProductHandle<Bond> _product = GetProductHandle<Bond>(NextToken(_line, ','));
+		double _bid = ConvertPrice(NextToken(_line, ','));
+		double _offer = ConvertPrice(NextToken(_line, ','));
+		_prices.push_back(Price<Bond>(_product, (_bid + _offer) / 2.0, _offer - _bid));
+	}
+	return _prices;
+}
+
+// Replay _prices _passes times through _publish, timing every tick.
+template<typename F>
+void ReplayPrices(const string& _name, vector<Price<Bond>>& _prices, int _passes, F _publish)
+{
+	vector<double> _latencies;
+	_latencies.reserve(_prices.size() * _passes);
+	{
+		SilenceConsole _silence;
+		for (int pass = 0; pass < _passes; ++pass)
+		{
+			for (auto& _price : _prices)
+			{
+				auto _start = steady_clock::now();
+				_publish(_price);
+				_latencies.push_back(duration<double, nano>(steady_clock::now() - _start).count());
+			}
+		}
+	}
+	ReportLatency(_name, _latencies);
+}
+
+// The string-based price conversions the codec replaced, kept as a baseline.
+namespace legacy
+{
+	double ConvertPrice(const string& priceStr)
+	{
+		size_t dashPos = priceStr.find('-');
+		double integralPart = stod(priceStr.substr(0, dashPos));
+		string fractionalPartStr = priceStr.substr(dashPos + 1);
+		int xy = stoi(fractionalPartStr.substr(0, 2));
+		char zChar = fractionalPartStr[2];
+		int z = (zChar == '+') ? 4 : zChar - '0';
+		return integralPart + xy / 32.0 + z / 256.0;
+	}
+
+	// The market data connector before books were built per product: the stacks were never cleared.
+	class AccumulatingBookBuilder
+	{
+	public:
+		void AddOrder(double _price, long _quantity, PricingSide _side)
+		{
+			(_side == BID ? bidStack : offerStack).push_back(Order(_price, _quantity, _side));
+			if (++count % 10 == 0)
+			{
+				vector<Order> _bids = bidStack;
+				vector<Order> _offers = offerStack;
+				DoNotOptimize(_bids.data());
+				DoNotOptimize(_offers.data());
+			}
+		}
+	private:
+		vector<Order> bidStack;
+		vector<Order> offerStack;
+		long count = 0;
+	};
+
+	// The coupon-sum PV01 the engine replaced, repricing twice with pow() per period.
+	double GetPV01Value(double yield, double maturity, double couponRate, double faceValue)
+	{
+		const int PAYMENTS_PER_YEAR = 2;
+		double couponPayment = couponRate * faceValue / PAYMENTS_PER_YEAR;
+		double presentValueOfCoupons = 0.0;
+		for (int i = 1; i <= maturity * PAYMENTS_PER_YEAR; ++i)
+			presentValueOfCoupons += couponPayment / pow(1 + yield / PAYMENTS_PER_YEAR, i);
+		double totalPresentValue = presentValueOfCoupons + faceValue / pow(1 + yield, maturity);
+
+		double adjustedYield = yield + 0.0001;
+		double adjustedPresentValueOfCoupons = 0.0;
+		for (int i = 1; i <= maturity * PAYMENTS_PER_YEAR; ++i)
+			adjustedPresentValueOfCoupons += couponPayment / pow(1 + adjustedYield / PAYMENTS_PER_YEAR, i);
+		double adjustedTotalPresentValue = adjustedPresentValueOfCoupons + faceValue / pow(1 + adjustedYield, maturity);
+		return totalPresentValue - adjustedTotalPresentValue;
+	}
+
+	// Position bookkeeping before the flat store: a map per product, walked for every aggregate.
+	struct MapPosition
+	{
+		map<string, long> positions;
+		void AddPosition(const string& _book, long _position) { positions[_book] += _position; }
+		long GetAggregatePosition() const
+		{
+			long _aggregate = 0;
+			for (auto& p : positions) _aggregate += p.second;
+			return _aggregate;
+		}
+	};
+
+	// The algo stream wrapper before pooling: one heap price stream per tick, never freed.
+	struct LeakingAlgoStream
+	{
+		PriceStream<Bond>* priceStream;
+		LeakingAlgoStream(ProductHandle<Bond> _product, const PriceStreamOrder& _bidOrder, const PriceStreamOrder& _offerOrder)
+			: priceStream(new PriceStream<Bond>(_product, _bidOrder, _offerOrder)) {}
+	};
+
+	// The synchronous logger the asynchronous one replaced: formats the time with put_time and flushes each line.
+	void Log(ostream& _out, LogLevel _level, const string& _message)
+	{
+		auto _now = system_clock::now();
+		time_t _nowT = system_clock::to_time_t(_now);
+		tm _nowTm;
+		localtime_r(&_nowT, &_nowTm);
+		auto _milliseconds = duration_cast<milliseconds>(_now.time_since_epoch()) % 1000;
+		ostringstream _time;
+		_time << put_time(&_nowTm, "%Y-%m-%d %H:%M:%S") << '.' << setfill('0') << setw(3) << _milliseconds.count();
+		string _levelStr = _level == LogLevel::INFO ? "INFO" : _level == LogLevel::WARNING ? "WARNING" : "ERROR";
+		_out << _time.str() << " [" << _levelStr << "] " << _message << endl;
+	}
+
+	// The order id generator the sequence-based one replaced: a fresh Lehmer stream seeded by the current millisecond.
+	string GenerateId()
+	{
+		string _base = "1234567890QWERTYUIOPASDFGHJKLZXCVBNM";
+		vector<double> _randoms = GenerateUniform(12, GetMillisecond());
+		string _id = "";
+		for (auto& r : _randoms)
+		{
+			int i = r * 36;
+			_id.push_back(_base[i]);
+		}
+		return _id;
+	}
+
+	string ConvertPrice(double _doublePrice)
+	{
+		int _doublePrice100 = floor(_doublePrice);
+		int _doublePrice256 = floor((_doublePrice - _doublePrice100) * 256.0);
+		int _doublePrice32 = floor(_doublePrice256 / 8.0);
+		int _doublePrice8 = _doublePrice256 % 8;
+		string _stringPrice100 = to_string(_doublePrice100);
+		string _stringPrice32 = to_string(_doublePrice32);
+		string _stringPrice8 = to_string(_doublePrice8);
+		if (_doublePrice32 < 10) _stringPrice32 = "0" + _stringPrice32;
+		if (_doublePrice8 == 4) _stringPrice8 = "+";
+		return _stringPrice100 + "-" + _stringPrice32 + _stringPrice8;
+	}
+}
+
+// Price codec against the legacy string conversions, both directions.
+void BenchmarkPriceCodec()
+{
+	const long _iterations = 2000000;
+	vector<string> _strings;
+	vector<double> _prices;
+	for (long t = 99 * 256; t < 101 * 256; ++t)
+	{
+		char _buffer[PRICE_BUFFER_SIZE];
+		_strings.push_back(string(_buffer, FormatPriceTicks(t, _buffer)));
+		_prices.push_back(TicksToPrice(t));
+	}
+	size_t _n = _strings.size();
+
+	Benchmark("legacy ConvertPrice(string)", _iterations, [&](long i) { DoNotOptimize(legacy::ConvertPrice(_strings[i % _n])); });
+	Benchmark("ParsePriceTicks(char range)", _iterations, [&](long i) {
+		const string& _s = _strings[i % _n];
+		DoNotOptimize(ParsePriceTicks(_s.data(), _s.data() + _s.size()));
+	});
+	Benchmark("ConvertPrice(string_view)", _iterations, [&](long i) { DoNotOptimize(ConvertPrice(string_view(_strings[i % _n]))); });
+	Benchmark("legacy ConvertPrice(double)", _iterations, [&](long i) { DoNotOptimize(legacy::ConvertPrice(_prices[i % _n])); });
+	Benchmark("FormatPriceTicks(buffer)", _iterations, [&](long i) {
+		char _buffer[PRICE_BUFFER_SIZE];
+		DoNotOptimize(FormatPriceTicks(PriceToTicks(_prices[i % _n]), _buffer));
+		DoNotOptimize(_buffer[0]);
+	});
+	Benchmark("ConvertPrice(double)", _iterations, [&](long i) { DoNotOptimize(ConvertPrice(_prices[i % _n])); });
+}
+
+// Per-tick latency of price -> algo stream -> stream -> sink, virtual listeners against a compile-time chain.
+void BenchmarkPriceDispatch()
+{
+	vector<Price<Bond>> _prices = LoadPrices("../data/prices.txt");
+
+	// virtual path, wired the way main.cpp does
+	{
+		PricingService<Bond> _pricing;
+		AlgoStreamingService<Bond> _algoStreaming;
+		StreamingService<Bond> _streaming;
+		CountingListener<PriceStream<Bond>> _sink;
+		_pricing.AddListener(_algoStreaming.GetListener());
+		_algoStreaming.AddListener(_streaming.GetListener());
+		_streaming.AddListener(&_sink);
+		ReplayPrices("price->stream virtual listeners", _prices, 20, [&](Price<Bond>& p) { _pricing.OnMessage(p); });
+	}
+
+	// compile-time chain through the same services
+	{
+		PricingService<Bond> _pricing;
+		AlgoStreamingService<Bond> _algoStreaming;
+		StreamingService<Bond> _streaming;
+		CountingListener<PriceStream<Bond>> _sink;
+		ChainedListener<StreamingListenerFromAlgoStreaming<Bond>, CountingListener<PriceStream<Bond>>> _streamingHop(*_streaming.GetListener(), _sink);
+		ChainedListener<AlgoStreamingToPricingListener<Bond>, decltype(_streamingHop)> _algoStreamingHop(*_algoStreaming.GetListener(), _streamingHop);
+		ReplayPrices("price->stream static chain", _prices, 20, [&](Price<Bond>& p) { _pricing.OnMessage(p, _algoStreamingHop); });
+	}
+
+	// end to end including the historical streaming service
+	{
+		PricingService<Bond> _pricing;
+		AlgoStreamingService<Bond> _algoStreaming;
+		StreamingService<Bond> _streaming;
+		HistoricalDataService<PriceStream<Bond>> _historical(STREAMING);
+		_pricing.AddListener(_algoStreaming.GetListener());
+		_algoStreaming.AddListener(_streaming.GetListener());
+		_streaming.AddListener(_historical.GetListener());
+		ReplayPrices("price->historical virtual listeners", _prices, 1, [&](Price<Bond>& p) { _pricing.OnMessage(p); });
+	}
+	{
+		PricingService<Bond> _pricing;
+		AlgoStreamingService<Bond> _algoStreaming;
+		StreamingService<Bond> _streaming;
+		HistoricalDataService<PriceStream<Bond>> _historical(STREAMING);
+		ListenerList<HistoricalDataListener<PriceStream<Bond>>> _historicalHop(*_historical.GetListener());
+		ChainedListener<StreamingListenerFromAlgoStreaming<Bond>, decltype(_historicalHop)> _streamingHop(*_streaming.GetListener(), _historicalHop);
+		ChainedListener<AlgoStreamingToPricingListener<Bond>, decltype(_streamingHop)> _algoStreamingHop(*_algoStreaming.GetListener(), _streamingHop);
+		ReplayPrices("price->historical static chain", _prices, 1, [&](Price<Bond>& p) { _pricing.OnMessage(p, _algoStreamingHop); });
+	}
+}
+
+// One parsed market data line.
+struct MarketDataLine
+{
+	ProductHandle<Bond> product;
+	double price;
+	long quantity;
+	PricingSide side;
+};
+
+// Parse marketdata.txt once so a replay measures only book building.
+vector<MarketDataLine> LoadMarketData(const string& _path)
+{
+	vector<MarketDataLine> _lines;
+	MappedFile _file(_path);
+	string_view _text = _file.View();
+	while (!_text.empty())
+	{
+		string_view _line = NextToken(_text, '\n');
+		if (_line.empty()) continue;
+		ProductHandle<Bond> _product = GetProductHandle<Bond>(NextToken(_line, ','));
+		double _price = ConvertPrice(NextToken(_line, ','));
+		long _quantity = ParseLong(NextToken(_line, ','));
+		PricingSide _side = ParsePricingSide(NextToken(_line, ','));
+		_lines.push_back({ _product, _price, _quantity, _side });
+	}
+	return _lines;
+}
+
+// Feed _lines updates through _feed and print the cost per update in each of _windows consecutive windows.
+template<typename F>
+void ReplayWindows(const string& _name, long _lines, int _windows, F _feed)
+{
+	cout << left << setw(48) << _name << right << fixed << setprecision(1);
+	long _size = _lines / _windows;
+	for (int w = 0; w < _windows; ++w)
+	{
+		auto _start = steady_clock::now();
+		for (long i = w * _size; i < (w + 1) * _size; ++i) _feed(i);
+		cout << setw(8) << duration<double, nano>(steady_clock::now() - _start).count() / _size;
+	}
+	cout << " ns/update per window" << endl;
+}
+
+// Book building over the market data file and a 10M-line synthetic feed, whose per-update cost should not grow with the feed.
+void BenchmarkMarketData()
+{
+	vector<MarketDataLine> _file = LoadMarketData("../data/marketdata.txt");
+	long _n = _file.size();
+
+	{
+		legacy::AccumulatingBookBuilder _builder;
+		ReplayWindows("marketdata.txt accumulating stacks", _n, 10, [&](long i) { _builder.AddOrder(_file[i].price, _file[i].quantity, _file[i].side); });
+	}
+	{
+		MarketDataService<Bond> _service;
+		CountingListener<OrderBook<Bond>> _books;
+		_service.AddListener(&_books);
+		ReplayWindows("marketdata.txt snapshots", _n, 10, [&](long i) {
+			_service.GetConnector()->AddOrder(_file[i].product, _file[i].price, _file[i].quantity, _file[i].side);
+		});
+	}
+	{
+		MarketDataService<Bond> _service;
+		CountingListener<LevelUpdate<Bond>> _levels;
+		_service.AddLevelListener(&_levels);
+		_service.GetConnector()->SetMode(DELTA);
+		ReplayWindows("marketdata.txt deltas", _n, 10, [&](long i) {
+			_service.GetConnector()->AddOrder(_file[i].product, _file[i].price, _file[i].quantity, _file[i].side);
+		});
+		cout << "  " << _levels.count << " levels added for " << _n / 10 << " books" << endl;
+	}
+
+	// synthetic feed: ten lines per book cycling over the bonds, with prices drifting a tick at a time
+	const long _lines = 10000000;
+	size_t _products = ProductRegistry<Bond>::Instance().Size();
+	auto _line = [&](long i) {
+		long _book = i / 10;
+		int _level = (i % 10) / 2;
+		PricingSide _side = (i % 2 == 0) ? BID : OFFER;
+		long _mid = 99 * TICKS_PER_POINT + (_book / _products) % 16;
+		long _ticks = (_side == BID) ? _mid - 1 - _level : _mid + 1 + _level;
+		return MarketDataLine{ ProductHandle<Bond>(size_t(_book % _products)), TicksToPrice(_ticks), 1000000L * (_level + 1), _side };
+	};
+	{
+		MarketDataService<Bond> _service;
+		CountingListener<OrderBook<Bond>> _books;
+		_service.AddListener(&_books);
+		ReplayWindows("10M synthetic snapshots", _lines, 10, [&](long i) {
+			MarketDataLine _l = _line(i);
+			_service.GetConnector()->AddOrder(_l.product, _l.price, _l.quantity, _l.side);
+		});
+	}
+	{
+		MarketDataService<Bond> _service;
+		CountingListener<LevelUpdate<Bond>> _levels;
+		_service.AddLevelListener(&_levels);
+		_service.GetConnector()->SetMode(DELTA);
+		ReplayWindows("10M synthetic deltas", _lines, 10, [&](long i) {
+			MarketDataLine _l = _line(i);
+			_service.GetConnector()->AddOrder(_l.product, _l.price, _l.quantity, _l.side);
+		});
+	}
+}
+
+// Top-of-book reads and single-level updates on a ten-level book.
+void BenchmarkOrderBook()
+{
+	const long _iterations = 2000000;
+	vector<Order> _bids, _offers;
+	for (int level = 0; level < 10; ++level)
+	{
+		_bids.push_back(Order(99.0 - level / 128.0, 1000000 * (level + 1), BID));
+		_offers.push_back(Order(99.0 + (level + 1) / 128.0, 1000000 * (level + 1), OFFER));
+	}
+	OrderBook<Bond> _book(ProductHandle<Bond>(size_t(0)), _bids, _offers);
+
+	Benchmark("OrderBook::GetBidOffer", _iterations, [&](long i) { DoNotOptimize(_book.GetBidOffer()); });
+	Benchmark("OrderBook::UpdateLevel modify", _iterations, [&](long i) {
+		_book.UpdateLevel(BID, 99.0 - (i % 10) / 128.0, 1000000 + i % 7);
+	});
+	Benchmark("OrderBook::UpdateLevel delete+insert", _iterations, [&](long i) {
+		double _price = 99.0 + (i % 10 + 1) / 128.0;
+		_book.UpdateLevel(OFFER, _price, 0);
+		_book.UpdateLevel(OFFER, _price, 1000000);
+	});
+
+	MarketDataService<Bond> _service;
+	for (int level = 0; level < 5; ++level)
+	{
+		_service.GetConnector()->AddOrder(_book.GetProductHandle(), _bids[level].GetPrice(), _bids[level].GetQuantity(), BID);
+		_service.GetConnector()->AddOrder(_book.GetProductHandle(), _offers[level].GetPrice(), _offers[level].GetQuantity(), OFFER);
+	}
+	const string& _productId = _book.GetProductHandle().Get().GetProductId();
+	Benchmark("MarketDataService::AggregateDepth", _iterations, [&](long i) { DoNotOptimize(_service.AggregateDepth(_productId).GetBidOffer()); });
+}
+
+// PV01 of the 30Y: coupon-sum loop, closed form, and the cached engine with a steady and a moving yield.
+void BenchmarkPV01()
+{
+	const long _iterations = 1000000;
+	size_t _index = GetProductHandle<Bond>("912810RZ3").GetIndex();
+	const Bond& _bond = ProductRegistry<Bond>::Instance().Get(_index);
+	int _periods = GetCouponPeriods(_bond);
+	PV01Engine& _engine = PV01Engine::Instance();
+	double _yield = _engine.GetYield(_index);
+
+	Benchmark("legacy GetPV01Value 30Y", _iterations / 10, [&](long i) {
+		DoNotOptimize(legacy::GetPV01Value(_yield + (i % 2) * 1e-9, _periods / 2.0, _bond.GetCoupon(), PV01_FACE_VALUE));
+	});
+	Benchmark("ClosedFormPV01 30Y", _iterations, [&](long i) {
+		DoNotOptimize(ClosedFormPV01(_bond.GetCoupon(), _yield + (i % 2) * 1e-9, _periods));
+	});
+	Benchmark("PV01Engine::GetPV01 cached", _iterations, [&](long i) { DoNotOptimize(_engine.GetPV01(_index)); });
+	Benchmark("PV01Engine::GetPV01 yield moving", _iterations, [&](long i) { DoNotOptimize(_engine.GetPV01(_index, _yield + (i % 2) * 1e-9)); });
+	_engine.SetYield(_index, _yield);
+
+	// whole-universe revaluation over 2,000 synthetic bonds: scalar loop against the batch kernel
+	const size_t _bonds = 2000;
+	vector<double> _yields(_bonds), _coupons(_bonds), _years(_bonds), _faces(_bonds, PV01_FACE_VALUE);
+	vector<double> _prices(_bonds), _pv01s(_bonds), _durations(_bonds);
+	vector<double> _batchPrices(_bonds), _batchPv01s(_bonds), _batchDurations(_bonds);
+	for (size_t i = 0; i < _bonds; ++i)
+	{
+		_years[i] = 0.5 * (1 + i % 60);
+		_coupons[i] = 0.01 + 0.00125 * (i % 24);
+		_yields[i] = 0.015 + 0.0001 * (i % 300);
+	}
+	Benchmark("ValueBondsScalar 2000 bonds", 2000, [&](long i) {
+		ValueBondsScalar(_yields.data(), _coupons.data(), _years.data(), _faces.data(), _prices.data(), _pv01s.data(), _durations.data(), _bonds);
+		DoNotOptimize(_pv01s[i % _bonds]);
+	});
+	Benchmark("ValueBonds batch 2000 bonds", 2000, [&](long i) {
+		ValueBonds(_yields.data(), _coupons.data(), _years.data(), _faces.data(), _batchPrices.data(), _batchPv01s.data(), _batchDurations.data(), _bonds);
+		DoNotOptimize(_batchPv01s[i % _bonds]);
+	});
+	double _error = 0;
+	for (size_t i = 0; i < _bonds; ++i)
+	{
+		_error = max(_error, fabs(_batchPv01s[i] - _pv01s[i]) / _pv01s[i]);
+		_error = max(_error, fabs(_batchPrices[i] - _prices[i]) / _prices[i]);
+		_error = max(_error, fabs(_batchDurations[i] - _durations[i]) / _durations[i]);
+	}
+	cout << "  batch against scalar max relative difference " << scientific << _error << fixed << endl;
+}
+
+// Bucketed risk: a registered sector's running total against summing the sector on every query.
+void BenchmarkBucketedRisk()
+{
+	const long _iterations = 1000000;
+	RiskService<Bond> _risk;
+	vector<Bond> _bonds;
+	PositionStore<Bond> _store;
+	vector<Position<Bond>> _positions;
+	for (size_t i = 0; i < bondCount; ++i)
+	{
+		_bonds.push_back(ProductRegistry<Bond>::Instance().Get(i));
+		_positions.push_back(Position<Bond>(ProductHandle<Bond>(i), _store));
+		_positions.back().AddPosition("TRSY1", 1000000 * (i + 1));
+		_risk.AddPosition(_positions.back());
+	}
+	BucketedSector<Bond> _sector(_bonds, "All");
+	size_t _id = _risk.RegisterSector(_sector);
+	auto _sum = [&]() {
+		double _pv01 = 0;
+		for (auto& b : _bonds)
+		{
+			const PV01<Bond>& _risked = _risk.GetData(b.GetProductId());
+			_pv01 += _risked.GetPV01() * _risked.GetQuantity();
+		}
+		return _pv01;
+	};
+
+	Benchmark("bucketed risk summed per query (7 bonds)", _iterations, [&](long i) { DoNotOptimize(_sum()); });
+	Benchmark("GetBucketedRisk running total by sector", _iterations, [&](long i) { DoNotOptimize(_risk.GetBucketedRisk(_sector).GetPV01()); });
+	Benchmark("GetBucketedRisk running total by id", _iterations, [&](long i) { DoNotOptimize(_risk.GetBucketedRisk(_id).GetPV01()); });
+	Benchmark("RiskService::AddPosition", _iterations, [&](long i) { _risk.AddPosition(_positions[i % bondCount]); });
+	cout << "  running total " << _risk.GetBucketedRisk(_id).GetPV01() << ", summed " << _sum() << endl;
+}
+
+// Booking a trade and reading the aggregate the risk service needs, across 32 books.
+void BenchmarkPositions()
+{
+	const long _iterations = 2000000;
+	const int _bookCount = 32;
+	vector<string> _books;
+	for (int b = 0; b < _bookCount; ++b) _books.push_back("BOOK" + to_string(b));
+
+	vector<legacy::MapPosition> _maps(bondCount);
+	Benchmark("legacy map AddPosition + aggregate", _iterations, [&](long i) {
+		legacy::MapPosition& _position = _maps[i % bondCount];
+		_position.AddPosition(_books[i % _bookCount], 1000000);
+		DoNotOptimize(_position.GetAggregatePosition());
+	});
+
+	PositionService<Bond> _service;
+	vector<Trade<Bond>> _trades;
+	for (int t = 0; t < 7 * _bookCount; ++t)
+		_trades.push_back(Trade<Bond>(ProductHandle<Bond>(size_t(t % bondCount)), "T" + to_string(t), 100.0, _books[t % _bookCount], 1000000, t % 2 == 0 ? BUY : SELL));
+	Benchmark("PositionService::AddTrade + aggregate", _iterations, [&](long i) {
+		const Trade<Bond>& _trade = _trades[i % _trades.size()];
+		_service.AddTrade(_trade);
+		DoNotOptimize(_service.GetStore().GetAggregate(_trade.GetProductHandle().GetIndex()));
+	});
+}
+
+// Resident set size of this process in MB.
+double ResidentMB()
+{
+	long _pages = 0, _resident = 0;
+	ifstream _statm("/proc/self/statm");
+	_statm >> _pages >> _resident;
+	return _resident * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+// Replay _ticks ticks through _publish, printing resident memory at five checkpoints.
+template<typename F>
+void ReplayResident(const string& _name, vector<Price<Bond>>& _prices, long _ticks, F _publish)
+{
+	cout << left << setw(48) << _name << right << fixed << setprecision(1) << setw(8) << ResidentMB();
+	for (long t = 0; t < _ticks; ++t)
+	{
+		_publish(_prices[t % _prices.size()]);
+		if ((t + 1) % (_ticks / 5) == 0) cout << setw(8) << ResidentMB();
+	}
+	cout << " MB resident" << endl;
+}
+
+// Resident memory over a long price replay: leaking wrappers against pooled, recycled ones.
+void BenchmarkPooledEvents()
+{
+	const long _ticks = 2000000;
+	vector<Price<Bond>> _prices = LoadPrices("../data/prices.txt");
+
+	// run the pooled replay first, so the leaked memory does not hide its footprint
+	AlgoStreamingService<Bond> _algoStreaming;
+	CountingListener<AlgoStream<Bond>> _sink;
+	_algoStreaming.AddListener(&_sink);
+	ReplayResident("2M ticks pooled AlgoStream", _prices, _ticks, [&](Price<Bond>& p) { _algoStreaming.AlgoPublishPrice(p); });
+	cout << "  " << _algoStreaming.GetPool().Capacity() << " price streams allocated, " << _algoStreaming.GetPool().InUse() << " in use" << endl;
+
+	ReplayResident("2M ticks leaking AlgoStream", _prices, _ticks, [&](Price<Bond>& p) {
+		PriceStreamOrder _bid(p.GetMid() - p.GetBidOfferSpread() / 2, 10000000, 20000000, BID);
+		PriceStreamOrder _offer(p.GetMid() + p.GetBidOfferSpread() / 2, 10000000, 20000000, OFFER);
+		legacy::LeakingAlgoStream _stream(p.GetProductHandle(), _bid, _offer);
+		DoNotOptimize(_stream.priceStream);
+	});
+}
+
+// Serializing records: joining ToStrings() against WriteTo() into a reused buffer, with heap allocations per record.
+void BenchmarkSerialization()
+{
+	const long _iterations = 1000000;
+	PositionStore<Bond> _store;
+	Position<Bond> _position(ProductHandle<Bond>(size_t(0)), _store);
+	_position.AddPosition("TRSY1", 1000000);
+	_position.AddPosition("TRSY2", -2000000);
+	_position.AddPosition("TRSY3", 3000000);
+	PriceStream<Bond> _stream(ProductHandle<Bond>(size_t(1)), PriceStreamOrder(99.5, 10000000, 20000000, BID), PriceStreamOrder(99.515625, 10000000, 20000000, OFFER));
+	ExecutionOrder<Bond> _order(ProductHandle<Bond>(size_t(2)), BID, "ABCDEFGHIJKL", MARKET, 99.75, 10000000, 0, "", false);
+
+	auto _measure = [&](const string& _name, auto _serialize) {
+		long _before = allocations.load();
+		Benchmark(_name, _iterations, _serialize);
+		cout << "  " << double(allocations.load() - _before) / (_iterations + _iterations / 10) << " allocations per record" << endl;
+	};
+	auto _join = [](const auto& _data) {
+		string _record = TimeStamp() + ",";
+		for (auto& s : _data.ToStrings())
+		{
+			_record += s;
+			_record += ',';
+		}
+		_record += '\n';
+		return _record.size();
+	};
+	RecordBuffer _buffer;
+	auto _write = [&](const auto& _data) {
+		_buffer.Clear();
+		_buffer.AppendTimeStamp();
+		_buffer.Append(',');
+		_data.WriteTo(_buffer);
+		_buffer.Append('\n');
+		return _buffer.Size();
+	};
+
+	_measure("Position ToStrings join", [&](long i) { DoNotOptimize(_join(_position)); });
+	_measure("Position WriteTo", [&](long i) { DoNotOptimize(_write(_position)); });
+	_measure("PriceStream ToStrings join", [&](long i) { DoNotOptimize(_join(_stream)); });
+	_measure("PriceStream WriteTo", [&](long i) { DoNotOptimize(_write(_stream)); });
+	_measure("ExecutionOrder ToStrings join", [&](long i) { DoNotOptimize(_join(_order)); });
+	_measure("ExecutionOrder WriteTo", [&](long i) { DoNotOptimize(_write(_order)); });
+}
+
+// Caller-side cost of a log line, synchronous against asynchronous, both writing to /dev/null.
+void BenchmarkLogging()
+{
+	const long _iterations = 200000;
+	const long _burst = 512;
+	ofstream _devNull("/dev/null");
+	FILE* _nullFile = fopen("/dev/null", "w");
+	Logger& _logger = Logger::Instance();
+	_logger.SetOutput(_nullFile);
+
+	Benchmark("log() synchronous, text", _iterations, [&](long i) {
+		legacy::Log(_devNull, LogLevel::INFO, "Market data mapped ingestion: " + to_string(i) + " lines, " + to_string(i * 0.5) + " MB");
+	});
+	// stay within one ring: flush between bursts, outside the timed calls
+	auto _async = [&](const string& _name, auto _log) {
+		vector<double> _latencies;
+		_latencies.reserve(_iterations);
+		for (long i = 0; i < _iterations; i += _burst)
+		{
+			for (long j = i; j < i + _burst; ++j)
+			{
+				auto _start = steady_clock::now();
+				_log(j);
+				_latencies.push_back(duration<double, nano>(steady_clock::now() - _start).count());
+			}
+			_logger.Flush();
+		}
+		ReportLatency(_name, _latencies);
+	};
+	_async("Logger::Log() asynchronous, text", [&](long i) {
+		_logger.Log(LogLevel::INFO, "{}", "Market data mapped ingestion: 1000000 lines, 30.5 MB");
+	});
+	_async("Logger::Log() asynchronous, 2 numbers", [&](long i) {
+		_logger.Log(LogLevel::INFO, "Market data mapped ingestion: {} lines, {} MB", i, i * 0.5);
+	});
+
+	auto _start = steady_clock::now();
+	for (long i = 0; i < _iterations; ++i)
+	{
+		_logger.Log(LogLevel::INFO, "Market data mapped ingestion: {} lines, {} MB", i, i * 0.5);
+		if (i % _burst == _burst - 1) _logger.Flush();
+	}
+	_logger.Flush();
+	double _seconds = duration<double>(steady_clock::now() - _start).count();
+	cout << "  asynchronous end to end " << fixed << setprecision(0) << _iterations / _seconds << " lines/sec, "
+	     << _logger.GetDropped() << " dropped" << endl;
+
+	_logger.SetOutput(stdout);
+	fclose(_nullFile);
+}
+// Order id generation, single-threaded cost and uniqueness of ids generated concurrently.
+void BenchmarkOrderIds()
+{
+	const long _iterations = 1000000;
+	const int _threads = 4;
+	const long _perThread = 2000000;
+
+	long _before = allocations.load();
+	Benchmark("GenerateId() legacy", _iterations / 10, [&](long i) { DoNotOptimize(legacy::GenerateId()); });
+	cout << "  " << double(allocations.load() - _before) / (_iterations / 10 + _iterations / 100) << " allocations per id" << endl;
+	_before = allocations.load();
+	char _id[ID_LENGTH];
+	Benchmark("IdGenerator::Next(buffer)", _iterations * 10, [&](long i) { IdGenerator::Instance().Next(_id); DoNotOptimize(_id); });
+	Benchmark("GenerateId()", _iterations * 10, [&](long i) { DoNotOptimize(GenerateId()); });
+	cout << "  " << double(allocations.load() - _before) / (_iterations * 22) << " allocations per id" << endl;
+
+	// the legacy generator repeats itself within a millisecond
+	vector<string> _legacy;
+	for (long i = 0; i < _iterations / 10; ++i) _legacy.push_back(legacy::GenerateId());
+	sort(_legacy.begin(), _legacy.end());
+	long _legacyUnique = unique(_legacy.begin(), _legacy.end()) - _legacy.begin();
+	cout << "  legacy: " << _legacyUnique << " distinct of " << _iterations / 10 << " ids" << endl;
+
+	// stress: several threads generate at once, then every id is checked against every other
+	vector<vector<array<char, ID_LENGTH>>> _ids(_threads, vector<array<char, ID_LENGTH>>(_perThread));
+	vector<thread> _workers;
+	auto _start = steady_clock::now();
+	for (int t = 0; t < _threads; ++t)
+	{
+		_workers.emplace_back([&, t]() {
+			for (auto& _buffer : _ids[t]) IdGenerator::Instance().Next(_buffer.data());
+		});
+	}
+	for (auto& w : _workers) w.join();
+	double _seconds = duration<double>(steady_clock::now() - _start).count();
+
+	vector<array<char, ID_LENGTH>> _all;
+	_all.reserve(_threads * _perThread);
+	for (auto& v : _ids) _all.insert(_all.end(), v.begin(), v.end());
+	sort(_all.begin(), _all.end());
+	long _duplicates = _all.end() - unique(_all.begin(), _all.end());
+	cout << "  " << _threads << " threads: " << fixed << setprecision(0) << _threads * _perThread / _seconds << " ids/sec, "
+	     << _duplicates << " duplicates of " << _threads * _perThread << " ids" << endl;
+	if (_duplicates != 0) exit(1);
+
+	// churn: more short-lived threads than there are slots, each handing its slot back as it exits
+	const int _churnThreads = 3000;
+	const int _churnIds = 10;
+	vector<array<char, ID_LENGTH>> _churned(_churnThreads * _churnIds);
+	for (int t = 0; t < _churnThreads; ++t)
+	{
+		thread([&, t]() {
+			for (int i = 0; i < _churnIds; ++i) IdGenerator::Instance().Next(_churned[t * _churnIds + i].data());
+		}).join();
+	}
+	sort(_churned.begin(), _churned.end());
+	_duplicates = _churned.end() - unique(_churned.begin(), _churned.end());
+	cout << "  " << _churnThreads << " short-lived threads: " << _duplicates << " duplicates of " << _churned.size() << " ids" << endl;
+	if (_duplicates != 0) exit(1);
+}
+// Run _func in a fresh scratch directory, so the files the services write stay apart from a real run's output.
+template<typename F>
+void InScratchDirectory(F _func)
+{
+	filesystem::path _cwd = filesystem::current_path();
+	char _dir[] = "/tmp/tradingsystem_bench.XXXXXX";
+	if (!mkdtemp(_dir)) throw runtime_error("cannot create a scratch directory");
+	filesystem::current_path(_dir);
+	_func();
+	filesystem::current_path(_cwd);
+	filesystem::remove_all(_dir);
+}
+
+// Time _passes runs of a connector's Subscribe over a data file and print the cost per line.
+template<typename F>
+void ReplaySubscribe(const string& _name, const string& _path, int _passes, F _subscribe)
+{
+	long _lines = 0;
+	{
+		ifstream _file(_path);
+		string _line;
+		while (getline(_file, _line)) _lines++;
+	}
+	auto _start = steady_clock::now();
+	{
+		SilenceConsole _silence;
+		for (int pass = 0; pass < _passes; ++pass) _subscribe();
+	}
+	double _seconds = duration<double>(steady_clock::now() - _start).count();
+	cout << left << setw(48) << _name << right << setw(12) << fixed << setprecision(2) << _seconds * 1e9 / (_lines * _passes) << " ns/line"
+	     << setw(12) << setprecision(0) << _lines * _passes / _seconds << " lines/sec" << endl;
+}
+
+// Each connector's parse loop over its data file, feeding a service with no listeners.
+void BenchmarkSubscribe()
+{
+	string _data = filesystem::absolute("../data").string();
+	InScratchDirectory([&]() {
+		PricingService<Bond> _pricing;
+		ReplaySubscribe("PricingConnector::Subscribe", _data + "/prices.txt", 20, [&]() {
+			ifstream _file(_data + "/prices.txt");
+			_pricing.GetConnector()->Subscribe(_file);
+		});
+		TradeBookingService<Bond> _tradeBooking;
+		ReplaySubscribe("TradeBookingConnector::Subscribe", _data + "/trades.txt", 2000, [&]() {
+			ifstream _file(_data + "/trades.txt");
+			_tradeBooking.GetConnector()->Subscribe(_file);
+		});
+		MarketDataService<Bond> _marketData;
+		ReplaySubscribe("MarketDataConnector::Subscribe", _data + "/marketdata.txt", 20, [&]() {
+			ifstream _file(_data + "/marketdata.txt");
+			_marketData.GetConnector()->Subscribe(_file);
+		});
+		ReplaySubscribe("MarketDataConnector::SubscribeMapped", _data + "/marketdata.txt", 20, [&]() {
+			_marketData.GetConnector()->SubscribeMapped(_data + "/marketdata.txt");
+		});
+		InquiryService<Bond> _inquiry;
+		ReplaySubscribe("InquiryConnector::Subscribe", _data + "/inquiries.txt", 2000, [&]() {
+			ifstream _file(_data + "/inquiries.txt");
+			_inquiry.GetConnector()->Subscribe(_file);
+		});
+	});
+}
+
+// Write _copies copies of a data file into _path, to get a file large enough to split across threads.
+long WriteCopies(const string& _source, const string& _path, int _copies)
+{
+	ifstream _in(_source);
+	string _text((istreambuf_iterator<char>(_in)), istreambuf_iterator<char>());
+	ofstream _out(_path);
+	for (int c = 0; c < _copies; ++c) _out << _text;
+	return count(_text.begin(), _text.end(), '\n') * static_cast<long>(_copies);
+}
+
+// Time one load of a large file and print the cost per line.
+template<typename F>
+void ReplayLoad(const string& _name, long _lines, F _load)
+{
+	auto _start = steady_clock::now();
+	_load();
+	double _seconds = duration<double>(steady_clock::now() - _start).count();
+	cout << left << setw(48) << _name << right << setw(12) << fixed << setprecision(2) << _seconds * 1e9 / _lines << " ns/line"
+	     << setw(12) << setprecision(0) << _lines / _seconds << " lines/sec" << endl;
+}
+
+// Parsing large price and market data files with the getline loops against the parallel loader on 1 to 8 threads,
+// both parse-only and delivering into a service with no listeners.
+void BenchmarkParallelLoad()
+{
+	string _data = filesystem::absolute("../data").string();
+	cout << "hardware threads: " << thread::hardware_concurrency() << endl;
+	InScratchDirectory([&]() {
+		long _priceLines = WriteCopies(_data + "/prices.txt", "prices.txt", 400);
+		long _bookLines = WriteCopies(_data + "/marketdata.txt", "marketdata.txt", 400);
+
+		PricingService<Bond> _pricing;
+		ReplayLoad("prices, getline Subscribe", _priceLines, [&]() {
+			ifstream _file("prices.txt");
+			_pricing.GetConnector()->Subscribe(_file);
+		});
+		for (size_t _threads : { 1, 2, 4, 8 })
+		{
+			ReplayLoad("prices, parse only, " + to_string(_threads) + " threads", _priceLines, [&]() {
+				long _count = 0;
+				ParallelLoader<Price<Bond>>(_threads).Load("prices.txt", &PricingConnector<Bond>::ParseLine, [&](Price<Bond>&) { _count++; });
+				if (_count != _priceLines) exit(1);
+			});
+			ReplayLoad("prices, SubscribeParallel, " + to_string(_threads) + " threads", _priceLines, [&]() {
+				_pricing.GetConnector()->SubscribeParallel("prices.txt", _threads);
+			});
+		}
+
+		MarketDataService<Bond> _marketData;
+		FILE* _nullFile = fopen("/dev/null", "w");
+		Logger::Instance().SetOutput(_nullFile);
+		ReplayLoad("market data, SubscribeMapped", _bookLines, [&]() {
+			_marketData.GetConnector()->SubscribeMapped("marketdata.txt");
+		});
+		Logger::Instance().SetOutput(stdout);
+		fclose(_nullFile);
+		for (size_t _threads : { 1, 2, 4, 8 })
+		{
+			ReplayLoad("market data, SubscribeParallel, " + to_string(_threads) + " threads", _bookLines, [&]() {
+				_marketData.GetConnector()->SubscribeParallel("marketdata.txt", _threads);
+			});
+		}
+	});
+}
+
+// Cost of persisting one record per data type through the historical connector, as text and as a journal.
+void BenchmarkHistoricalPublish()
+{
+	const long _iterations = 500000;
+	PositionStore<Bond> _store;
+	Position<Bond> _position(ProductHandle<Bond>(size_t(0)), _store);
+	_position.AddPosition("TRSY1", 1000000);
+	_position.AddPosition("TRSY2", -2000000);
+	PV01<Bond> _pv01(GetProductHandle<Bond>("9128283F5"), 0.0876, 1000000);
+	ExecutionOrder<Bond> _order(ProductHandle<Bond>(size_t(2)), BID, "ABCDEFGHIJKL", MARKET, 99.75, 10000000, 0, "", false);
+	PriceStream<Bond> _stream(ProductHandle<Bond>(size_t(1)), PriceStreamOrder(99.5, 10000000, 20000000, BID), PriceStreamOrder(99.515625, 10000000, 20000000, OFFER));
+	Inquiry<Bond> _inquiry("QWERTYUIOP01", ProductHandle<Bond>(size_t(3)), BUY, 10000000, 99.875, DONE);
+
+	auto _publish = [&](const string& _name, ServiceType _type, auto& _data) {
+		for (PersistFormat _format : { TEXT, JOURNAL })
+		{
+			HistoricalDataService<remove_reference_t<decltype(_data)>> _historical(_type, _format);
+			Benchmark(_name + (_format == TEXT ? " text" : " journal"), _iterations, [&](long i) { _historical.GetConnector()->Publish(_data); });
+			_historical.GetConnector()->Flush();
+		}
+	};
+	InScratchDirectory([&]() {
+		_publish("historical Publish Position", POSITION, _position);
+		_publish("historical Publish PV01", RISK, _pv01);
+		_publish("historical Publish ExecutionOrder", EXECUTION, _order);
+		_publish("historical Publish PriceStream", STREAMING, _stream);
+		_publish("historical Publish Inquiry", INQUIRY, _inquiry);
+	});
+}
+
+// GUI updates on the pricing path, and how many of them reach gui.txt after conflation.
+void BenchmarkGUI()
+{
+	const long _iterations = 2000000;
+	vector<Price<Bond>> _prices = LoadPrices("../data/prices.txt");
+	InScratchDirectory([&]() {
+		GUIService<Bond> _gui;
+		auto _start = steady_clock::now();
+		Benchmark("GUIService::OnMessage", _iterations, [&](long i) { _gui.OnMessage(_prices[i % _prices.size()]); });
+		double _seconds = duration<double>(steady_clock::now() - _start).count();
+		_gui.GetConnector()->Sync();
+		cout << "  " << _iterations + _iterations / 10 << " updates over " << fixed << setprecision(2) << _seconds << " s, "
+		     << _gui.GetConnector()->GetSnapshots() << " snapshots, " << _gui.GetConnector()->GetRecords() << " records written" << endl;
+	});
+}
+
+// A consumer that needs _cost of work per event, standing in for a slow downstream service.
+template<typename V>
+class SlowListener final : public ServiceListener<V>
+{
+public:
+	explicit SlowListener(nanoseconds _cost) : cost(_cost) {}
+	void ProcessAdd(V& _data) override
+	{
+		auto _until = steady_clock::now() + cost;
+		while (steady_clock::now() < _until) {}
+		count++;
+	}
+	void ProcessRemove(V& _data) override {}
+	void ProcessUpdate(V& _data) override {}
+	long count = 0;
+private:
+	nanoseconds cost;
+};
+
+// A fast price feed into a slow consumer on another thread: a bounded queue that blocks the producer
+// against a conflation stage that keeps only the latest price per product.
+void BenchmarkConflation()
+{
+	const long _ticks = 500000;
+	const nanoseconds _cost(1000);
+	vector<Price<Bond>> _prices = LoadPrices("../data/prices.txt");
+
+	{
+		ConflatingListener<Price<Bond>> _stage;
+		Benchmark("ConflatingListener::ProcessAdd", 2000000, [&](long i) { _stage.ProcessAdd(_prices[i % _prices.size()]); });
+	}
+	{
+		SPSCQueue<Price<Bond>> _queue(1024);
+		SlowListener<Price<Bond>> _consumer(_cost);
+		thread _worker([&]() {
+			Price<Bond> _price;
+			while (!_queue.Drained())
+			{
+				if (_queue.TryPop(_price)) _consumer.ProcessAdd(_price);
+			}
+		});
+		auto _start = steady_clock::now();
+		for (long t = 0; t < _ticks; ++t) _queue.Push(_prices[t % _prices.size()]);
+		double _producer = duration<double, nano>(steady_clock::now() - _start).count() / _ticks;
+		_queue.Close();
+		_worker.join();
+		double _seconds = duration<double>(steady_clock::now() - _start).count();
+		cout << left << setw(48) << "blocking queue, 1 us consumer" << right << fixed << setprecision(1) << setw(12) << _producer << " ns/tick producer, "
+		     << _consumer.count << " delivered, done in " << setprecision(3) << _seconds << " s" << endl;
+	}
+	{
+		ConflatingListener<Price<Bond>> _stage;
+		SlowListener<Price<Bond>> _consumer(_cost);
+		size_t _maxPending = 0;
+		thread _worker([&]() {
+			while (!_stage.Drained()) _stage.WaitAndDrain(_consumer);
+		});
+		auto _start = steady_clock::now();
+		for (long t = 0; t < _ticks; ++t)
+		{
+			_stage.ProcessAdd(_prices[t % _prices.size()]);
+			if (t % 1024 == 0) _maxPending = max(_maxPending, _stage.Pending());
+		}
+		double _producer = duration<double, nano>(steady_clock::now() - _start).count() / _ticks;
+		_stage.Close();
+		_worker.join();
+		double _seconds = duration<double>(steady_clock::now() - _start).count();
+		cout << left << setw(48) << "conflating stage, 1 us consumer" << right << fixed << setprecision(1) << setw(12) << _producer << " ns/tick producer, "
+		     << _consumer.count << " delivered, done in " << setprecision(3) << _seconds << " s" << endl;
+		cout << "  " << _stage.GetConflated() << " conflated, at most " << _maxPending << " pending" << endl;
+	}
+}
+
+// A fast stream feed into a 1 us consumer through a 1024-event edge under each overflow policy.
+void BenchmarkBackPressure()
+{
+	const long _events = 200000;
+	vector<PriceStream<Bond>> _streams;
+	for (auto& p : LoadPrices("../data/prices.txt"))
+	{
+		PriceStreamOrder _bid(p.GetMid() - p.GetBidOfferSpread() / 2, 1000000, 2000000, BID);
+		PriceStreamOrder _offer(p.GetMid() + p.GetBidOfferSpread() / 2, 1000000, 2000000, OFFER);
+		_streams.push_back(PriceStream<Bond>(p.GetProductHandle(), _bid, _offer));
+	}
+
+	for (EdgePolicy _policy : { BLOCK, DROP_OLDEST, CONFLATE, SPILL })
+	{
+		SlowListener<PriceStream<Bond>> _consumer(nanoseconds(1000));
+		EdgeStats _stats;
+		auto _start = steady_clock::now();
+		double _producer;
+		{
+			BoundedEdge<PriceStream<Bond>> _edge(EdgePolicyName(_policy), &_consumer, _policy, 1024);
+			for (long e = 0; e < _events; ++e) _edge.ProcessAdd(_streams[e % _streams.size()]);
+			_producer = duration<double, nano>(steady_clock::now() - _start).count() / _events;
+			_edge.Close();
+			_stats = _edge.GetStats();
+		}
+		double _seconds = duration<double>(steady_clock::now() - _start).count();
+		cout << left << setw(48) << string("edge, ") + EdgePolicyName(_policy) + ", 1 us consumer" << right << fixed << setprecision(1) << setw(12) << _producer
+		     << " ns/event producer, " << _stats.delivered << " delivered, done in " << setprecision(3) << _seconds << " s" << endl;
+		cout << "  high water " << _stats.highWater << ", " << _stats.blocked << " blocked, " << _stats.dropped << " dropped, "
+		     << _stats.conflated << " conflated, " << _stats.spilled << " spilled" << endl;
+	}
+}
+
+// Records, for every event a service publishes, the time since the source event entered the graph,
+// and once the source event is done, its end to end latency, so both are reported over the same events.
+template<typename V>
+class HopProbe final : public ServiceListener<V>
+{
+public:
+	HopProbe(const string& _name, const steady_clock::time_point& _ingress) : name(_name), ingress(_ingress) {}
+	void ProcessAdd(V& _data) override { Record(); }
+	void ProcessRemove(V& _data) override {}
+	void ProcessUpdate(V& _data) override { Record(); }
+	// Get the number of events recorded since the last report
+	size_t GetRecorded() const { return latencies.size(); }
+	// Give the events recorded for the current source event its end to end latency
+	void Finish(double _endToEnd) { endToEnd.resize(latencies.size(), _endToEnd); }
+	// Print and forget the latencies recorded since the last report
+	void Report(const string& _feed)
+	{
+		if (latencies.empty()) return;
+		ReportLatency("  " + _feed + " -> " + name + " (" + to_string(latencies.size()) + ")", latencies);
+		ReportLatency("    end to end, same events", endToEnd);
+		latencies.clear();
+		endToEnd.clear();
+	}
+private:
+	void Record() { latencies.push_back(duration<double, nano>(steady_clock::now() - ingress).count()); }
+	string name;
+	const steady_clock::time_point& ingress;
+	vector<double> latencies;
+	vector<double> endToEnd;
+};
+
+// Parse inquiries.txt once so a replay measures only the service graph.
+vector<Inquiry<Bond>> LoadInquiries(const string& _path)
+{
+	vector<Inquiry<Bond>> _inquiries;
+	MappedFile _file(_path);
+	string_view _text = _file.View();
+	while (!_text.empty())
+	{
+		string_view _line = NextToken(_text, '\n');
+		if (_line.empty()) continue;
+		string _inquiryId(NextToken(_line, ','));
+		ProductHandle<Bond> _product = GetProductHandle<Bond>(NextToken(_line, ','));
+		Side _side = ParseSide(NextToken(_line, ','));
+		long _quantity = ParseLong(NextToken(_line, ','));
+		double _price = ConvertPrice(NextToken(_line, ','));
+		_inquiries.push_back(Inquiry<Bond>(_inquiryId, _product, _side, _quantity, _price, RECEIVED));
+	}
+	return _inquiries;
+}
+
+// The four data files replayed through the full service graph of main.cpp, one feed after another:
+// lines/sec per feed and latency from the source line to every service it reaches. End to end runs from a line
+// going in to the last listener returning, and is taken over the lines the feed's first service published on
+// (e.g. the line completing an order book). Not every published event reaches every later service, so each hop
+// is followed by the end to end latency of the same events, which is never below it.
+void BenchmarkEndToEnd()
+{
+	const int _passes = 10;
+	string _data = filesystem::absolute("../data").string();
+	vector<Price<Bond>> _prices = LoadPrices(_data + "/prices.txt");
+	vector<MarketDataLine> _books = LoadMarketData(_data + "/marketdata.txt");
+	vector<Inquiry<Bond>> _inquiries = LoadInquiries(_data + "/inquiries.txt");
+
+	InScratchDirectory([&]() {
+		PricingService<Bond> pricingService;
+		TradeBookingService<Bond> tradeBookingService;
+		PositionService<Bond> positionService;
+		RiskService<Bond> riskService;
+		MarketDataService<Bond> marketDataService;
+		AlgoExecutionService<Bond> algoExecutionService;
+		AlgoStreamingService<Bond> algoStreamingService;
+		GUIService<Bond> guiService;
+		ExecutionService<Bond> executionService;
+		StreamingService<Bond> streamingService;
+		InquiryService<Bond> inquiryService;
+		HistoricalDataService<Position<Bond>> historicalPositionService(POSITION);
+		HistoricalDataService<PV01<Bond>> historicalRiskService(RISK);
+		HistoricalDataService<ExecutionOrder<Bond>> historicalExecutionService(EXECUTION);
+		HistoricalDataService<PriceStream<Bond>> historicalStreamingService(STREAMING);
+		HistoricalDataService<Inquiry<Bond>> historicalInquiryService(INQUIRY);
+
+		// probes go first on every service, so they see an event as soon as the service publishes it
+		steady_clock::time_point _ingress;
+		HopProbe<Price<Bond>> _pricingProbe("pricing", _ingress);
+		HopProbe<AlgoStream<Bond>> _algoStreamingProbe("algo streaming", _ingress);
+		HopProbe<PriceStream<Bond>> _streamingProbe("streaming", _ingress);
+		HopProbe<OrderBook<Bond>> _marketDataProbe("market data", _ingress);
+		HopProbe<AlgoExecution<Bond>> _algoExecutionProbe("algo execution", _ingress);
+		HopProbe<ExecutionOrder<Bond>> _executionProbe("execution", _ingress);
+		HopProbe<Trade<Bond>> _tradeBookingProbe("trade booking", _ingress);
+		HopProbe<Position<Bond>> _positionProbe("position", _ingress);
+		HopProbe<PV01<Bond>> _riskProbe("risk", _ingress);
+		HopProbe<Inquiry<Bond>> _inquiryProbe("inquiry", _ingress);
+		pricingService.AddListener(&_pricingProbe);
+		algoStreamingService.AddListener(&_algoStreamingProbe);
+		streamingService.AddListener(&_streamingProbe);
+		marketDataService.AddListener(&_marketDataProbe);
+		algoExecutionService.AddListener(&_algoExecutionProbe);
+		executionService.AddListener(&_executionProbe);
+		tradeBookingService.AddListener(&_tradeBookingProbe);
+		positionService.AddListener(&_positionProbe);
+		riskService.AddListener(&_riskProbe);
+		inquiryService.AddListener(&_inquiryProbe);
+		auto _finish = [&](double _endToEnd) {
+			_pricingProbe.Finish(_endToEnd);
+			_algoStreamingProbe.Finish(_endToEnd);
+			_streamingProbe.Finish(_endToEnd);
+			_marketDataProbe.Finish(_endToEnd);
+			_algoExecutionProbe.Finish(_endToEnd);
+			_executionProbe.Finish(_endToEnd);
+			_tradeBookingProbe.Finish(_endToEnd);
+			_positionProbe.Finish(_endToEnd);
+			_riskProbe.Finish(_endToEnd);
+			_inquiryProbe.Finish(_endToEnd);
+		};
+		auto _report = [&](const string& _feed) {
+			_pricingProbe.Report(_feed);
+			_algoStreamingProbe.Report(_feed);
+			_streamingProbe.Report(_feed);
+			_marketDataProbe.Report(_feed);
+			_algoExecutionProbe.Report(_feed);
+			_executionProbe.Report(_feed);
+			_tradeBookingProbe.Report(_feed);
+			_positionProbe.Report(_feed);
+			_riskProbe.Report(_feed);
+			_inquiryProbe.Report(_feed);
+		};
+
+		// linked as main.cpp links them, sequential mode
+		pricingService.AddListener(algoStreamingService.GetListener());
+		pricingService.AddListener(guiService.GetListener());
+		algoStreamingService.AddListener(streamingService.GetListener());
+		streamingService.AddListener(historicalStreamingService.GetListener());
+		marketDataService.AddListener(algoExecutionService.GetListener());
+		algoExecutionService.AddListener(executionService.GetListener());
+		executionService.AddListener(historicalExecutionService.GetListener());
+		tradeBookingService.AddListener(positionService.GetListener());
+		positionService.AddListener(riskService.GetListener());
+		positionService.AddListener(historicalPositionService.GetListener());
+		riskService.AddListener(historicalRiskService.GetListener());
+		inquiryService.AddListener(historicalInquiryService.GetListener());
+		executionService.AddListener(tradeBookingService.GetListener());
+
+		// replay one feed, timing each source event through everything it triggers
+		long _totalEvents = 0;
+		double _totalSeconds = 0;
+		auto _replay = [&](const string& _feed, long _events, const auto& _entry, auto _publish) {
+			vector<double> _latencies;
+			_latencies.reserve(_events * _passes);
+			auto _start = steady_clock::now();
+			{
+				SilenceConsole _silence;
+				for (int pass = 0; pass < _passes; ++pass)
+				{
+					for (long i = 0; i < _events; ++i)
+					{
+						size_t _published = _entry.GetRecorded();
+						_ingress = steady_clock::now();
+						_publish(i);
+						double _latency = duration<double, nano>(steady_clock::now() - _ingress).count();
+						if (_entry.GetRecorded() > _published) _latencies.push_back(_latency);
+						_finish(_latency);
+					}
+				}
+			}
+			double _seconds = duration<double>(steady_clock::now() - _start).count();
+			_totalEvents += _events * _passes;
+			_totalSeconds += _seconds;
+			cout << _feed << ": " << _events * _passes << " lines, " << fixed << setprecision(0) << _events * _passes / _seconds << " lines/sec, "
+			     << _latencies.size() << " published" << endl;
+			ReportLatency("  " + _feed + " end to end", _latencies);
+			_report(_feed);
+		};
+
+		_replay("prices", _prices.size(), _pricingProbe, [&](long i) { pricingService.OnMessage(_prices[i]); });
+		// parse trades.txt with the connector itself, collecting the trades instead of booking them
+		vector<Trade<Bond>> _trades;
+		struct Collect { vector<Trade<Bond>>& trades; void ProcessAdd(Trade<Bond>& _trade) { trades.push_back(_trade); } } _collect{ _trades };
+		ifstream _tradeFile(_data + "/trades.txt");
+		tradeBookingService.GetConnector()->Subscribe(_tradeFile, _collect);
+		_replay("trades", _trades.size(), _tradeBookingProbe, [&](long i) { tradeBookingService.OnMessage(_trades[i]); });
+		_replay("market data", _books.size(), _marketDataProbe, [&](long i) {
+			marketDataService.GetConnector()->AddOrder(_books[i].product, _books[i].price, _books[i].quantity, _books[i].side);
+		});
+		_replay("inquiries", _inquiries.size(), _inquiryProbe, [&](long i) {
+			Inquiry<Bond> _inquiry = _inquiries[i];
+			inquiryService.OnMessage(_inquiry);
+		});
+		cout << "all feeds: " << _totalEvents << " lines, " << fixed << setprecision(0) << _totalEvents / _totalSeconds << " lines/sec" << endl;
+	});
+}
+// Write price, market data, trade and inquiry files cycling over the first _bonds products of the registry.
+long WriteUniverseFeeds(size_t _bonds, long _ticksPerBond, long _booksPerBond, long _tradesPerBond)
+{
+	const ProductRegistry<Bond>& _registry = ProductRegistry<Bond>::Instance();
+	ofstream _prices("prices.txt"), _books("marketdata.txt"), _trades("trades.txt"), _inquiries("inquiries.txt");
+	auto _price = [](long _ticks) { char _digits[PRICE_BUFFER_SIZE]; return string(_digits, FormatPriceTicks(_ticks, _digits)); };
+	const long _par = 100 * TICKS_PER_POINT;
+	for (long t = 0; t < _ticksPerBond * static_cast<long>(_bonds); ++t)
+	{
+		long _mid = _par + t % 7 - 3;
+		_prices << _registry.Get(t % _bonds).GetProductId() << ',' << _price(_mid - 1) << ',' << _price(_mid + 1) << '\n';
+	}
+	for (long b = 0; b < _booksPerBond * static_cast<long>(_bonds); ++b)
+	{
+		const string& _id = _registry.Get(b % _bonds).GetProductId();
+		for (int l = 0; l < 5; ++l)
+		{
+			_books << _id << ',' << _price(_par - 1 - 4 * l) << ',' << 10000000L * (l + 1) << ",BID\n";
+			_books << _id << ',' << _price(_par + 1 + 4 * l) << ',' << 10000000L * (l + 1) << ",OFFER\n";
+		}
+	}
+	const char* _tradeBooks[] = { "TRSY1", "TRSY2", "TRSY3" };
+	for (long t = 0; t < _tradesPerBond * static_cast<long>(_bonds); ++t)
+	{
+		const string& _id = _registry.Get(t % _bonds).GetProductId();
+		_trades << _id << ",T" << t << ',' << _price(_par) << ',' << _tradeBooks[t % 3] << ',' << 1000000L * (1 + t % 5) << (t % 2 == 0 ? ",BUY\n" : ",SELL\n");
+		_inquiries << 'Q' << t << ',' << _id << (t % 2 == 0 ? ",BUY," : ",SELL,") << 1000000L * (1 + t % 5) << ',' << _price(_par) << ",RECEIVED\n";
+	}
+	return _bonds * (_ticksPerBond + _booksPerBond * 10 + 2 * _tradesPerBond);
+}
+
+// The service graph of main.cpp over a 2,000-bond universe: all feeds through one copy of the services on one
+// thread, then split into 1 to 8 shards by product with one feed thread per file.
+// Registers the synthetic universe, so it runs last.
+void BenchmarkSharding()
+{
+	const size_t _bonds = 2000;
+	RegisterUniverse(_bonds);
+	// the streaming and execution connectors print every event; discard that while the graphs run
+	SilenceConsole _silence;
+	cout << "hardware threads: " << thread::hardware_concurrency() << endl;
+	InScratchDirectory([&]() {
+		long _events = WriteUniverseFeeds(_bonds, 100, 20, 10);
+		double _inline = 0;
+		{
+			ServiceShard<Bond> _graph(ShardSinks<Bond>(), 5);
+			// valued up front, as ShardedServiceGraph::Start() does for every shard
+			_graph.engine.Revalue();
+			auto _start = steady_clock::now();
+			_graph.pricing.GetConnector()->SubscribeParallel("prices.txt", 1);
+			_graph.tradeBooking.GetConnector()->SubscribeParallel("trades.txt", 1);
+			_graph.marketData.GetConnector()->SubscribeParallel("marketdata.txt", 1);
+			_graph.inquiry.GetConnector()->SubscribeParallel("inquiries.txt", 1);
+			_inline = duration<double>(steady_clock::now() - _start).count();
+			cout << left << setw(48) << "2000 bonds, one thread" << right << fixed << setprecision(0) << setw(12) << _events / _inline << " events/sec" << endl;
+		}
+		for (size_t _shards : { 1, 2, 4, 8 })
+		{
+			ShardedServiceGraph<Bond> _graph(_shards, ShardSinks<Bond>(), 5);
+			auto _start = steady_clock::now();
+			_graph.Start();
+			thread _priceFeed([&]() { _graph.FeedPrices("prices.txt"); });
+			thread _tradeFeed([&]() { _graph.FeedTrades("trades.txt"); });
+			thread _bookFeed([&]() { _graph.FeedMarketData("marketdata.txt"); });
+			thread _inquiryFeed([&]() { _graph.FeedInquiries("inquiries.txt"); });
+			_priceFeed.join();
+			_tradeFeed.join();
+			_bookFeed.join();
+			_inquiryFeed.join();
+			_graph.Join();
+			double _seconds = duration<double>(steady_clock::now() - _start).count();
+			long _least = *min_element(_graph.GetProcessed().begin(), _graph.GetProcessed().end());
+			long _most = *max_element(_graph.GetProcessed().begin(), _graph.GetProcessed().end());
+			cout << left << setw(48) << "2000 bonds, " + to_string(_shards) + " shards" << right << fixed << setprecision(0) << setw(12) << _events / _seconds
+			     << " events/sec, " << setprecision(2) << _inline / _seconds << "x one thread, " << _least << "-" << _most << " events per shard" << endl;
+			// shards and feed threads time-share the cores they outnumber, so the ratio then measures overhead, not scaling
+			if (thread::hardware_concurrency() < _shards + 4)
+				cout << "    " << _shards + 4 << " threads on " << thread::hardware_concurrency() << " hardware threads: not a measure of scaling across cores" << endl;
+		}
+	});
+}
+
+int main()
+{
+	// a single scratch session, so its order ids never meet another run's
+	IdGenerator::Instance().SetSession(0);
+	BenchmarkPriceCodec();
+	BenchmarkPriceDispatch();
+	BenchmarkOrderBook();
+	BenchmarkMarketData();
+	BenchmarkPV01();
+	BenchmarkBucketedRisk();
+	BenchmarkPositions();
+	BenchmarkPooledEvents();
+	BenchmarkSerialization();
+	BenchmarkLogging();
+	BenchmarkOrderIds();
+	BenchmarkSubscribe();
+	BenchmarkParallelLoad();
+	BenchmarkHistoricalPublish();
+	BenchmarkGUI();
+	BenchmarkConflation();
+	BenchmarkBackPressure();
+	BenchmarkEndToEnd();
+	BenchmarkSharding();
+	return 0;
+}
@@ -0,0 +1,289 @@
+/**
+* datagen.cpp
+* Generates prices.txt, marketdata.txt, trades.txt and inquiries.txt in the layout of the files in data/
+* for a bond universe of any size, for scale testing. The same seed always produces the same files.
+*
+* Usage: datagen [--bonds N] [--ticks N] [--books N] [--depth N] [--trades N] [--inquiries N] [--seed N] [--out DIR]
+*/
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+#include "functions.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+// Bytes buffered per file before they are written out
+const size_t DATAGEN_BUFFER_SIZE = 1 << 20;
+
+// Prices stay within this many 1/256ths either side of par
+const long PRICE_RANGE = TICKS_PER_POINT;
+
+// Ticks between the levels of a generated book, on each side
+const long LEVEL_STEP = 4;
+
+/**
+* Deterministic pseudo-random source (splitmix64).
+*/
+class Random
+{
+public:
+	explicit Random(uint64_t _seed) : state(_seed) {}
+	uint64_t Next()
+	{
+		uint64_t _z = (state += 0x9e3779b97f4a7c15ULL);
+		_z = (_z ^ (_z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		_z = (_z ^ (_z >> 27)) * 0x94d049bb133111ebULL;
+		return _z ^ (_z >> 31);
+	}
+	// Get a number in [0, _n)
+	long Below(long _n)
+	{
+		return static_cast<long>(Next() % static_cast<uint64_t>(_n));
+	}
+private:
+	uint64_t state;
+};
+
+/**
+* Output file written through a large reused buffer.
+*/
+class DataFile
+{
+public:
+	explicit DataFile(const string& _path) : file(fopen(_path.c_str(), "w")), path(_path), buffer(DATAGEN_BUFFER_SIZE + 256)
+	{
+		if (!file) throw runtime_error("cannot open " + _path);
+	}
+	~DataFile()
+	{
+		if (file) fclose(file);
+	}
+	// Write out what is still buffered and close the file
+	void Close()
+	{
+		Flush();
+		if (fclose(file) != 0) throw runtime_error("cannot close " + path);
+		file = nullptr;
+	}
+	void Text(string_view _text)
+	{
+		buffer.Append(_text);
+	}
+	void Price(long _ticks)
+	{
+		char _digits[PRICE_BUFFER_SIZE];
+		buffer.Append(_digits, FormatPriceTicks(_ticks, _digits));
+	}
+	void Integer(long _value)
+	{
+		char _digits[24];
+		buffer.Append(_digits, to_chars(_digits, _digits + sizeof(_digits), _value).ptr - _digits);
+	}
+	void Comma()
+	{
+		buffer.Append(',');
+	}
+	void EndLine()
+	{
+		buffer.Append('\n');
+		if (buffer.Size() >= DATAGEN_BUFFER_SIZE) Flush();
+	}
+private:
+	void Flush()
+	{
+		if (fwrite(buffer.Data(), 1, buffer.Size(), file) != buffer.Size()) throw runtime_error("cannot write " + path);
+		buffer.Clear();
+	}
+
+	FILE* file;
+	string path;
+	RecordBuffer buffer;
+};
+
+// Write a unique 12-character id: _prefix then eleven base-36 digits of a bijective scramble of _sequence.
+void WriteId(DataFile& _file, char _prefix, uint64_t _sequence, uint64_t _seed)
+{
+	const unsigned __int128 _modulus = 131621703842267136ULL; // 36^11
+	// 0x9e3779b97f4a7c15 is odd and not a multiple of 3, so it is invertible modulo 36^11
+	uint64_t _value = static_cast<uint64_t>((static_cast<unsigned __int128>(_sequence) * 0x9e3779b97f4a7c15ULL + _seed) % _modulus);
+	char _id[12];
+	_id[0] = _prefix;
+	for (int i = 11; i > 0; --i)
+	{
+		_id[i] = ID_ALPHABET[_value % ID_BASE];
+		_value /= ID_BASE;
+	}
+	_file.Text(string_view(_id, sizeof(_id)));
+}
+
+// Move a product's mid by at most a tick, staying within PRICE_RANGE of par.
+long Step(Random& _random, long _mid)
+{
+	const long _par = 100 * TICKS_PER_POINT;
+	long _next = _mid + _random.Below(3) - 1;
+	return (_next < _par - PRICE_RANGE || _next > _par + PRICE_RANGE) ? _mid : _next;
+}
+
+// prices.txt: product, bid, offer, cycling over the universe with a 1/128 or 1/64 spread.
+void WritePrices(const string& _path, size_t _bonds, long _ticks, Random& _random)
+{
+	DataFile _file(_path);
+	vector<long> _mids(_bonds, 100 * TICKS_PER_POINT);
+	const ProductRegistry<Bond>& _registry = ProductRegistry<Bond>::Instance();
+	for (long t = 0; t < _ticks; ++t)
+	{
+		size_t _bond = t % _bonds;
+		long _mid = _mids[_bond] = Step(_random, _mids[_bond]);
+		long _halfSpread = (t / _bonds) % 2 == 0 ? 1 : 2;
+		_file.Text(_registry.Get(_bond).GetProductId());
+		_file.Comma();
+		_file.Price(_mid - _halfSpread);
+		_file.Comma();
+		_file.Price(_mid + _halfSpread);
+		_file.EndLine();
+	}
+	_file.Close();
+}
+
+// marketdata.txt: product, price, quantity, side; each book is _depth bid and offer lines, best level first and widening by LEVEL_STEP.
+void WriteMarketData(const string& _path, size_t _bonds, long _books, int _depth, Random& _random)
+{
+	DataFile _file(_path);
+	vector<long> _mids(_bonds, 100 * TICKS_PER_POINT);
+	const ProductRegistry<Bond>& _registry = ProductRegistry<Bond>::Instance();
+	for (long b = 0; b < _books; ++b)
+	{
+		size_t _bond = b % _bonds;
+		long _mid = _mids[_bond] = Step(_random, _mids[_bond]);
+		const string& _productId = _registry.Get(_bond).GetProductId();
+		for (int level = 0; level < _depth; ++level)
+		{
+			long _quantity = 10000000L * (level + 1);
+			_file.Text(_productId);
+			_file.Comma();
+			_file.Price(_mid - 1 - LEVEL_STEP * level);
+			_file.Comma();
+			_file.Integer(_quantity);
+			_file.Text(",BID");
+			_file.EndLine();
+			_file.Text(_productId);
+			_file.Comma();
+			_file.Price(_mid + 1 + LEVEL_STEP * level);
+			_file.Comma();
+			_file.Integer(_quantity);
+			_file.Text(",OFFER");
+			_file.EndLine();
+		}
+	}
+	_file.Close();
+}
+
+// trades.txt: product, trade id, price, book, quantity, side, alternating BUY and SELL over books TRSY1-3.
+void WriteTrades(const string& _path, size_t _bonds, long _trades, uint64_t _seed, Random& _random)
+{
+	DataFile _file(_path);
+	const ProductRegistry<Bond>& _registry = ProductRegistry<Bond>::Instance();
+	const string_view _books[] = { "TRSY1", "TRSY2", "TRSY3" };
+	for (long t = 0; t < _trades; ++t)
+	{
+		_file.Text(_registry.Get(t % _bonds).GetProductId());
+		_file.Comma();
+		WriteId(_file, '7', t, _seed);
+		_file.Comma();
+		_file.Price(99 * TICKS_PER_POINT + _random.Below(2 * TICKS_PER_POINT));
+		_file.Comma();
+		_file.Text(_books[t % 3]);
+		_file.Comma();
+		_file.Integer(10000000L * (1 + t % 5));
+		_file.Text(t % 2 == 0 ? ",BUY" : ",SELL");
+		_file.EndLine();
+	}
+	_file.Close();
+}
+
+// inquiries.txt: inquiry id, product, side, quantity, price, RECEIVED.
+void WriteInquiries(const string& _path, size_t _bonds, long _inquiries, uint64_t _seed, Random& _random)
+{
+	DataFile _file(_path);
+	const ProductRegistry<Bond>& _registry = ProductRegistry<Bond>::Instance();
+	for (long i = 0; i < _inquiries; ++i)
+	{
+		WriteId(_file, 'Q', i, _seed);
+		_file.Comma();
+		_file.Text(_registry.Get(i % _bonds).GetProductId());
+		_file.Text(i % 2 == 0 ? ",BUY," : ",SELL,");
+		_file.Integer(10000000L * (1 + i % 5));
+		_file.Comma();
+		_file.Price(99 * TICKS_PER_POINT + _random.Below(2 * TICKS_PER_POINT));
+		_file.Text(",RECEIVED");
+		_file.EndLine();
+	}
+	_file.Close();
+}
+
+int main(int argc, char* argv[])
+{
+	// defaults match the size of the files in data/
+	long _bonds = 7, _ticks = 6126, _books = 612, _depth = 5, _trades = 60, _inquiries = 60;
+	uint64_t _seed = 1;
+	string _out = ".";
+	bool _valid = true;
+	for (int i = 1; i < argc && _valid; i += 2)
+	{
+		string _flag = argv[i];
+		if (i + 1 == argc) { _valid = false; break; }
+		string _value = argv[i + 1];
+		try
+		{
+			if (_flag == "--bonds") _bonds = stol(_value);
+			else if (_flag == "--ticks") _ticks = stol(_value);
+			else if (_flag == "--books") _books = stol(_value);
+			else if (_flag == "--depth") _depth = stol(_value);
+			else if (_flag == "--trades") _trades = stol(_value);
+			else if (_flag == "--inquiries") _inquiries = stol(_value);
+			else if (_flag == "--seed") _seed = stoull(_value);
+			else if (_flag == "--out") _out = _value;
+			else _valid = false;
+		}
+		catch (const logic_error&)
+		{
+			_valid = false;
+		}
+	}
+	if (!_valid)
+	{
+		cerr << "Usage: " << argv[0] << " [--bonds N] [--ticks N] [--books N] [--depth N] [--trades N] [--inquiries N] [--seed N] [--out DIR]" << endl;
+		return 1;
+	}
+	if (_bonds < 1 || _depth < 1)
+	{
+		cerr << "--bonds and --depth must be at least 1" << endl;
+		return 1;
+	}
+
+	size_t _universe = RegisterUniverse(_bonds);
+	auto _start = steady_clock::now();
+	try
+	{
+		// one independent stream per file, so changing one file's size leaves the others unchanged
+		Random _priceRandom(_seed), _bookRandom(_seed + 1), _tradeRandom(_seed + 2), _inquiryRandom(_seed + 3);
+		WritePrices(_out + "/prices.txt", _universe, _ticks, _priceRandom);
+		WriteMarketData(_out + "/marketdata.txt", _universe, _books, _depth, _bookRandom);
+		WriteTrades(_out + "/trades.txt", _universe, _trades, _seed, _tradeRandom);
+		WriteInquiries(_out + "/inquiries.txt", _universe, _inquiries, _seed, _inquiryRandom);
+	}
+	catch (const exception& e)
+	{
+		log(LogLevel::ERROR, e.what());
+		return 1;
+	}
+
+	long _lines = _ticks + _books * _depth * 2 + _trades + _inquiries;
+	double _seconds = duration<double>(steady_clock::now() - _start).count();
+	Logger::Instance().Log(LogLevel::INFO, "Generated {} lines for {} bonds in {} s ({} lines/sec)", _lines, _universe, _seconds, _lines / _seconds);
+	return 0;
+}
@@ -9,6 +9,7 @@
 
 #include <string>
 #include "soa.hpp"
+#include "logger.hpp"
 #include "algoexecutionservice.hpp"
 
 /**
@@ -28,7 +29,7 @@ template<typename T>
 class ExecutionService : public Service<string, ExecutionOrder<T>>
 {
 private:
-    map<string, ExecutionOrder<T>> executionOrders;
+    ProductTable<T, ExecutionOrder<T>> executionOrders;
     ExecutionServiceConnector<T>* connector; // connector related to this server
     vector<ServiceListener<ExecutionOrder<T>>*> listeners;
     ExecutionToAlgoExecutionListener<T>* listener;
@@ -37,7 +38,6 @@ public:
     // Constructor
     ExecutionService()
     {
-        executionOrders = map<string, ExecutionOrder<T>>();
         listeners = vector<ServiceListener<ExecutionOrder<T>>*>();
         listener = new ExecutionToAlgoExecutionListener<T>(this);
         connector = new ExecutionServiceConnector<T>(this);
@@ -47,12 +47,12 @@ public:
     // Get data on our service given a key
     ExecutionOrder<T>& GetData(string _key)
     {
-        return executionOrders[_key];
+        return executionOrders.At(_key);
     }
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(ExecutionOrder<T>& _data)
     {
-        executionOrders[_data.GetProduct().GetProductId()] = _data;
+        executionOrders[_data.GetProductHandle()] = _data;
     }
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
     void AddListener(ServiceListener<ExecutionOrder<T>>* _listener)
@@ -72,8 +72,7 @@ public:
     // Execute an order on a market
     void ExecuteOrder(ExecutionOrder<T>& _executionOrder)
     {
-        string _productId = _executionOrder.GetProduct().GetProductId();
-        executionOrders[_productId] = _executionOrder;
+        executionOrders[_executionOrder.GetProductHandle()] = _executionOrder;
         connector->Publish(_executionOrder);
         for (auto& l : listeners)
         {
@@ -98,8 +97,8 @@ public:
     // Publish data to the Connector
     void Publish(ExecutionOrder<T>& order) override{
         // print the execution order data
-        auto product = order.GetProduct();
-        string order_type;
+        const T& product = order.GetProduct();
+        const char* order_type = "";
         switch (order.GetOrderType()) {
             case FOK: order_type = "FOK"; break;
             case MARKET: order_type = "MARKET"; break;
@@ -108,12 +107,27 @@ public:
             case IOC: order_type = "IOC"; break;
         }
 
-        cout << "ExecutionOrder: \n"
-             << "\tProduct: " << product.GetProductId() << "\tOrderId: " << order.GetOrderId()  << "\n"
-             << "\tPricingSide: " << (order.GetPricingSide() == BID ? "Bid" : "Offer")
-             << "\tOrderType: " << order_type << "\t\tIsChildOrder: " << (order.IsChildOrder() ? "True" : "False") << "\n"
-             << "\tPrice: " << order.GetPrice() << "\tVisibleQuantity: " << order.GetVisibleQuantity()
-             << "\tHiddenQuantity: " << order.GetHiddenQuantity() << endl << endl;
+        // formatted into a reused buffer and written out by the logger thread
+        thread_local RecordBuffer _text;
+        _text.Clear();
+        _text.Append("ExecutionOrder: \n\tProduct: ");
+        _text.Append(product.GetProductId());
+        _text.Append("\tOrderId: ");
+        _text.Append(order.GetOrderId());
+        _text.Append("\n\tPricingSide: ");
+        _text.Append(order.GetPricingSide() == BID ? "Bid" : "Offer");
+        _text.Append("\tOrderType: ");
+        _text.Append(order_type);
+        _text.Append("\t\tIsChildOrder: ");
+        _text.Append(order.IsChildOrder() ? "True" : "False");
+        _text.Append("\n\tPrice: ");
+        _text.AppendNumber(order.GetPrice());
+        _text.Append("\tVisibleQuantity: ");
+        _text.AppendInteger(order.GetVisibleQuantity());
+        _text.Append("\tHiddenQuantity: ");
+        _text.AppendInteger(order.GetHiddenQuantity());
+        _text.Append("\n\n");
+        Logger::Instance().Write(_text.View());
     }
     void Subscribe(ifstream& _data) override {}
 };
@@ -7,8 +7,13 @@
 #ifndef GUI_SERVICE_HPP
 #define GUI_SERVICE_HPP
 
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "soa.hpp"
 #include "pricingservice.hpp"
+#include "asyncwriter.hpp"
 
 /**
 * Pre-declearations to avoid errors.
@@ -21,43 +26,75 @@ class GUIToPricingListener;
 /**
 * Service for outputing GUI with a certain throttle.
 * Keyed on product identifier.
+* The latest price of each product is kept together with the set of products changed since the last
+* snapshot; the connector writes one coalesced snapshot of those products every throttle interval,
+* so the pricing path only stores the price and does no I/O.
+* The prices are shared with the snapshot thread, so GetData returns a copy taken under the lock rather than
+* the reference a Service<string, Price<T>> returns, and the class does not derive from Service.
 * Type T is the product type.
 */
 template<typename T>
-class GUIService : Service<string, Price<T>>
+class GUIService
 {
 private:
-    map<string, Price<T>> guis;
+    ProductTable<T, Price<T>> guis;
+    vector<size_t> dirty;   // products changed since the last snapshot
+    vector<char> isDirty;   // per product index, whether it is in dirty
+    mutex guard;            // guards guis and the dirty set against the snapshot thread
     vector<ServiceListener<Price<T>>*> listeners;
     GUIConnector<T>* connector;
-    ServiceListener<Price<T>>* listener;
+    GUIToPricingListener<T>* listener;
     int throttle;
-    long millisec;
 
 public:
     // Constructor
-    GUIService() : throttle(300), millisec(0)
+    GUIService() : throttle(300)
     {
-        guis = map<string, Price<T>>();
         listeners = vector<ServiceListener<Price<T>>*>();
         connector = new GUIConnector<T>(this);
         listener = new GUIToPricingListener<T>(this);
     }
 
-    // Destructor
-    ~GUIService() {}
+    // Destructor, writing out the last snapshot
+    ~GUIService()
+    {
+        delete connector;
+        delete listener;
+    }
 
-    // Get data on our service given a key
-    Price<T>& GetData(string _key)
+    // Get a copy of the data on our service given a key
+    Price<T> GetData(string _key)
     {
-        return guis[_key];
+        lock_guard<mutex> _lock(guard);
+        return guis.At(_key);
     }
 
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(Price<T>& _data)
     {
-        guis[_data.GetProduct().GetProductId()] = _data;
-        connector->Publish(_data);
+        size_t _index = _data.GetProductHandle().GetIndex();
+        lock_guard<mutex> _lock(guard);
+        guis[_index] = _data;
+        if (_index >= isDirty.size()) isDirty.resize(_index + 1, false);
+        if (!isDirty[_index])
+        {
+            isDirty[_index] = true;
+            dirty.push_back(_index);
+        }
+    }
+
+    // Copy the latest price of every product changed since the last snapshot into _snapshot, in product order
+    void TakeSnapshot(vector<Price<T>>& _snapshot)
+    {
+        _snapshot.clear();
+        lock_guard<mutex> _lock(guard);
+        sort(dirty.begin(), dirty.end());
+        for (size_t _index : dirty)
+        {
+            _snapshot.push_back(guis.At(_index));
+            isDirty[_index] = false;
+        }
+        dirty.clear();
     }
 
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -79,67 +116,125 @@ public:
     }
 
     // Get the listener of the service
-    ServiceListener<Price<T>>* GetListener()
+    GUIToPricingListener<T>* GetListener()
     {
         return listener;
     }
 
-    // Get the throttle of the service
+    // Get the throttle of the service in milliseconds
     int GetThrottle() const
     {
         return throttle;
     }
+};
 
-    // Get the millisec of the service
-    long GetMillisec() const
+/**
+* GUI Connector writing coalesced snapshots of the GUI service to gui.txt.
+* A background thread wakes every throttle interval on the monotonic clock and writes the latest
+* price of each product changed since the previous snapshot.
+* Type T is the product type.
+*/
+template<typename T>
+class GUIConnector final : public Connector<Price<T>>
+{
+private:
+    GUIService<T>* service;
+    AsyncFileWriter writer;      // persistent handle onto gui.txt
+    RecordBuffer record;         // reused for every record
+    vector<Price<T>> snapshot;   // reused for every snapshot
+    long snapshots;
+    long records;
+    mutex publishGuard;          // guards record and the counters, so one snapshot or record is written at a time
+    mutex timerGuard;
+    condition_variable wake;
+    bool stopping;
+    thread timer;
+
+    // Timer loop: write a snapshot every throttle interval, and a last one when stopping
+    void Run()
     {
-        return millisec;
+        milliseconds _interval(service->GetThrottle());
+        steady_clock::time_point _next = steady_clock::now() + _interval;
+        unique_lock<mutex> _lock(timerGuard);
+        while (true)
+        {
+            bool _stopping = wake.wait_until(_lock, _next, [&]() { return stopping; });
+            _lock.unlock();
+            PublishSnapshot();
+            _lock.lock();
+            if (_stopping) return;
+            _next = max(_next + _interval, steady_clock::now());
+        }
     }
 
-    // Set the millisec of the service
-    void SetMillisec(long _millisec)
+    // Write one record to gui.txt; called with publishGuard held
+    void WriteRecord(const Price<T>& _data)
     {
-        millisec = _millisec;
+        record.Clear();
+        record.AppendTimeStamp();
+        record.Append(',');
+        _data.WriteTo(record);
+        record.Append('\n');
+        writer.Append(record.Data(), record.Size());
+        records++;
     }
-};
-template<typename T>
-class GUIConnector : public Connector<Price<T>>
-{
-private:
-    GUIService<T>* service;
 
 public:
     // Constructor
-    GUIConnector(GUIService<T>* _service) : service(_service) {}
-
-    // Destructor
-    ~GUIConnector() {}
+    GUIConnector(GUIService<T>* _service) : service(_service), writer("gui.txt"), snapshots(0), records(0), stopping(false)
+    {
+        timer = thread(&GUIConnector::Run, this);
+    }
 
-    // Publish data to the Connector
-    void Publish(Price<T>& _data)
+    // Destructor, writing out the last snapshot
+    ~GUIConnector()
     {
-        int _throttle = service->GetThrottle();
-        long _millisec = service->GetMillisec();
-        long _millisecNow = GetMillisecond();
-        while (_millisecNow < _millisec) _millisecNow += 1000;
-        if (_millisecNow - _millisec >= _throttle)
         {
-            service->SetMillisec(_millisecNow);
-            ofstream _file;
-            _file.open("gui.txt", ios::app);
-
-            _file << TimeStamp() << ",";
-            vector<string> _strings = _data.ToStrings();
-            for (auto& s : _strings)
-            {
-                _file << s << ",";
-            }
-            _file << endl;
+            lock_guard<mutex> _lock(timerGuard);
+            stopping = true;
         }
+        wake.notify_one();
+        timer.join();
+    }
+
+    // Publish data to the Connector: write one record to gui.txt
+    void Publish(Price<T>& _data)
+    {
+        lock_guard<mutex> _lock(publishGuard);
+        WriteRecord(_data);
+    }
+
+    // Write the products changed since the last snapshot now
+    void PublishSnapshot()
+    {
+        lock_guard<mutex> _lock(publishGuard);
+        service->TakeSnapshot(snapshot);
+        if (snapshot.empty()) return;
+        for (auto& _price : snapshot) WriteRecord(_price);
+        snapshots++;
+    }
+
+    // Get the number of snapshots and records written so far
+    long GetSnapshots()
+    {
+        lock_guard<mutex> _lock(publishGuard);
+        return snapshots;
+    }
+    long GetRecords()
+    {
+        lock_guard<mutex> _lock(publishGuard);
+        return records;
     }
 
     // Subscribe data from the Connector
     void Subscribe(ifstream& _data){}
+
+    // Durability barrier: write the pending snapshot and wait until everything written so far is on stable storage
+    void Sync()
+    {
+        PublishSnapshot();
+        writer.Sync();
+    }
 };
 
 /**
@@ -147,7 +242,7 @@ public:
 * Type T is the product type.
 */
 template<typename T>
-class GUIToPricingListener : public ServiceListener<Price<T>>
+class GUIToPricingListener final : public ServiceListener<Price<T>>
 {
 private:
     GUIService<T>* service;
@@ -8,10 +8,21 @@
 #ifndef HISTORICAL_DATA_SERVICE_HPP
 #define HISTORICAL_DATA_SERVICE_HPP
 
+#include <type_traits>
 #include "soa.hpp"
+#include "asyncwriter.hpp"
+#include "journal.hpp"
+#include <sys/stat.h>
 
 enum ServiceType { POSITION, RISK, EXECUTION, STREAMING, INQUIRY };
 
+// How historical data is persisted: comma-joined text, or binary journal records (see journal.hpp)
+enum PersistFormat { TEXT, JOURNAL };
+
+// Product type of a data type V, i.e. the type returned by V::GetProduct()
+template<typename V>
+using ProductOf = typename decay<decltype(declval<V>().GetProduct())>::type;
+
 /**
 * Pre-declearations to avoid errors.
 */
@@ -29,39 +40,44 @@ template<typename V>
 class HistoricalDataService : Service<string, V>
 {
 private:
-    map<string, V> historicalDatas;
+    ProductTable<ProductOf<V>, V> historicalDatas;
     vector<ServiceListener<V>*> listeners;
     HistoricalDataConnector<V>* connector;
-    ServiceListener<V>* listener;
+    HistoricalDataListener<V>* listener;
     ServiceType type;
+    PersistFormat format;
+    FlushPolicy flushPolicy;
 
 public:
     // Constructor
-    HistoricalDataService() : type(INQUIRY)
+    HistoricalDataService() : type(INQUIRY), format(TEXT)
     {
-        historicalDatas = map<string, V>();
         listeners = vector<ServiceListener<V>*>();
         connector = new HistoricalDataConnector<V>(this);
         listener = new HistoricalDataListener<V>(this);
     }
-    HistoricalDataService(ServiceType _type) : type(_type)
+    HistoricalDataService(ServiceType _type, PersistFormat _format = TEXT, const FlushPolicy& _flushPolicy = FlushPolicy())
+        : type(_type), format(_format), flushPolicy(_flushPolicy)
     {
-        historicalDatas = map<string, V>();
         listeners = vector<ServiceListener<V>*>();
         connector = new HistoricalDataConnector<V>(this);
         listener = new HistoricalDataListener<V>(this);
     }
-    // Destructor
-    ~HistoricalDataService() {}
+    // Destructor, writing out everything persisted so far
+    ~HistoricalDataService()
+    {
+        delete connector;
+        delete listener;
+    }
     // Get data on our service given a key
     V& GetData(string _key)
     {
-        return historicalDatas[_key];
+        return historicalDatas.At(_key);
     }
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(V& _data)
     {
-        historicalDatas[_data.GetProduct().GetProductId()] = _data;
+        historicalDatas[_data.GetProductHandle()] = _data;
     }
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
     void AddListener(ServiceListener<V>* _listener)
@@ -79,7 +95,7 @@ public:
         return connector;
     }
     // Get the listener of the service
-    ServiceListener<V>* GetListener()
+    HistoricalDataListener<V>* GetListener()
     {
         return listener;
     }
@@ -88,8 +104,18 @@ public:
     {
         return type;
     }
-    // Persist data to a store
-    void PersistData(string _persistKey, V& _data)
+    // Get the format data is persisted in
+    PersistFormat GetPersistFormat() const
+    {
+        return format;
+    }
+    // Get how the persisted file is buffered and flushed
+    const FlushPolicy& GetFlushPolicy() const
+    {
+        return flushPolicy;
+    }
+    // Persist data to a store; data is keyed on its product, which the record carries
+    void PersistData(V& _data)
     {
         connector->Publish(_data);
     }
@@ -101,14 +127,43 @@ public:
 * Type V is the data type to persist.
 */
 template<typename V>
-class HistoricalDataConnector : public Connector<V>
+class HistoricalDataConnector final : public Connector<V>
 {
 private:
     HistoricalDataService<V>* service;
+    AsyncFileWriter writer; // persistent handle, written on a background thread
+
+    // Get the file that data from a service type is persisted to
+    static string GetFileName(ServiceType _type, PersistFormat _format)
+    {
+        string _extension = (_format == JOURNAL) ? ".journal" : ".txt";
+        switch (_type)
+        {
+            case POSITION: return "positions" + _extension;
+            case RISK: return "risk" + _extension;
+            case EXECUTION: return "executions" + _extension;
+            case STREAMING: return "streaming" + _extension;
+            case INQUIRY: return "allinquiries" + _extension;
+        }
+        return "";
+    }
+
+    // Start a new journal file with its header
+    void WriteJournalHeader(const string& _fileName)
+    {
+        struct stat _stat;
+        if (stat(_fileName.c_str(), &_stat) == 0 && _stat.st_size > 0) return;
+        JournalHeader _header = MakeJournalHeader<V>();
+        writer.Append(reinterpret_cast<const char*>(&_header), sizeof(_header));
+    }
 
 public:
     // Constructor
-    HistoricalDataConnector(HistoricalDataService<V>* _service) : service(_service) {}
+    HistoricalDataConnector(HistoricalDataService<V>* _service)
+        : service(_service), writer(GetFileName(_service->GetServiceType(), _service->GetPersistFormat()), _service->GetFlushPolicy())
+    {
+        if (service->GetPersistFormat() == JOURNAL) WriteJournalHeader(GetFileName(service->GetServiceType(), JOURNAL));
+    }
 
     // Destructor
     ~HistoricalDataConnector() {}
@@ -116,34 +171,33 @@ public:
     // Publish data to the Connector
     void Publish(V& _data)
     {
-        ServiceType _type = service->GetServiceType();
-        ofstream _file;
-        switch (_type)
+        // one buffer per publishing thread, so several threads (e.g. shards) can publish at once
+        thread_local RecordBuffer _record;
+        _record.Clear();
+        if (service->GetPersistFormat() == JOURNAL)
         {
-            case POSITION:
-                _file.open("positions.txt", ios::app);
-                break;
-            case RISK:
-                _file.open("risk.txt", ios::app);
-                break;
-            case EXECUTION:
-                _file.open("executions.txt", ios::app);
-                break;
-            case STREAMING:
-                _file.open("streaming.txt", ios::app);
-                break;
-            case INQUIRY:
-                _file.open("allinquiries.txt", ios::app);
-                break;
+            AppendJournalRecord(_data, JournalTimestamp(), _record);
+            writer.Append(_record.Data(), _record.Size());
+            return;
         }
 
-        _file << TimeStamp() << ",";
-        vector<string> _strings = _data.ToStrings();
-        for (auto& s : _strings)
-        {
-            _file << s << ",";
-        }
-        _file << endl;
+        _record.AppendTimeStamp();
+        _record.Append(',');
+        _data.WriteTo(_record);
+        _record.Append('\n');
+        writer.Append(_record.Data(), _record.Size());
+    }
+
+    // Wait until every record published so far is written to the file
+    void Flush()
+    {
+        writer.Flush();
+    }
+
+    // Durability barrier: wait until every record published so far is on stable storage
+    void Sync()
+    {
+        writer.Sync();
     }
 
     // Subscribe data from the Connector
@@ -158,7 +212,7 @@ public:
 * Type V is the data type to persist.
 */
 template<typename V>
-class HistoricalDataListener : public ServiceListener<V>{
+class HistoricalDataListener final : public ServiceListener<V>{
 private:
     HistoricalDataService<V>* service;
 public:
@@ -169,8 +223,7 @@ public:
     // Listener callback to process an add event to the Service
     void ProcessAdd(V& _data)
     {
-        string _persistKey = _data.GetProduct().GetProductId();
-        service->PersistData(_persistKey, _data);
+        service->PersistData(_data);
     }
     // Listener callback to process a remove event to the Service
     void ProcessRemove(V& _data)
@@ -0,0 +1,190 @@
+/**
+* idgenerator.hpp
+* Defines a generator of unique 12-character order ids in the base-36 alphabet of the original GenerateId().
+* An id is a configured session prefix, a thread slot and a per-thread sequence number, so ids never repeat
+* across sessions with distinct prefixes, and generating one takes no lock and no allocation once a thread holds a slot.
+* Successive runs draw distinct prefixes from a session counter file with ClaimSession().
+*
+*/
+#ifndef ID_GENERATOR_HPP
+#define ID_GENERATOR_HPP
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+using namespace std;
+
+// Alphabet of generated ids, one character per base-36 digit
+const char ID_ALPHABET[] = "1234567890QWERTYUIOPASDFGHJKLZXCVBNM";
+const uint64_t ID_BASE = 36;
+
+// Length of an id and of its parts: session prefix, thread slot, then sequence number
+const size_t ID_LENGTH = 12;
+const size_t ID_SESSION_DIGITS = 3;
+const size_t ID_THREAD_DIGITS = 2;
+const size_t ID_SEQUENCE_DIGITS = ID_LENGTH - ID_SESSION_DIGITS - ID_THREAD_DIGITS;
+
+/**
+* Process-wide id generator.
+* The session prefix comes from configuration through SetSession(), one per node and session, so ids from
+* different sessions never collide; no id is generated before it is set. Within a session every thread holds
+* its own slot and counts up, giving 36^7 (about 78 billion) ids per slot before it moves to a fresh slot.
+* A thread hands its slot back when it exits, together with where its sequence stopped, so the next thread
+* continues from there and 36^2 slots are only exhausted by that many threads generating ids at once.
+* Each thread keeps its current id encoded and increments it in place, so most calls change only the last character.
+*/
+class IdGenerator{
+public:
+	// Get the id generator
+	static IdGenerator& Instance(){
+        static IdGenerator _generator;
+        return _generator;
+    }
+	IdGenerator(const IdGenerator&) = delete;
+	IdGenerator& operator=(const IdGenerator&) = delete;
+
+	// Write the next id into _buffer (at least ID_LENGTH chars, not terminated)
+	void Next(char* _buffer){
+        ThreadState& _state = LocalState();
+        if (_state.slot < 0 || !Increment(_state)) Claim(_state);
+        memcpy(_buffer, _state.id, ID_LENGTH);
+    }
+	// Get the next id
+	string Next(){
+        char _id[ID_LENGTH];
+        Next(_id);
+        return string(_id, ID_LENGTH);
+    }
+	// Get the session prefix as a number below 36^3
+	uint64_t GetSession() const{
+        return session.load(memory_order_acquire);
+    }
+	// Set the session prefix assigned to this node and session (below 36^3); call before generating ids
+	void SetSession(uint64_t _session){
+        if (_session >= Power(ID_SESSION_DIGITS)) throw out_of_range("order id session must be below " + to_string(Power(ID_SESSION_DIGITS)));
+        lock_guard<mutex> _lock(guard);
+        if (nextSlot > 0 && session.load(memory_order_relaxed) != _session) throw logic_error("order id session set after ids were generated");
+        session.store(_session, memory_order_release);
+    }
+private:
+	static constexpr uint64_t NO_SESSION = static_cast<uint64_t>(-1);
+
+	// A slot and where its sequence stopped
+	struct Slot{
+		long slot;
+		uint8_t digits[ID_SEQUENCE_DIGITS];   // last sequence number issued, most significant digit first
+	};
+	struct ThreadState{
+		long slot = -1;                       // thread slot, -1 before the first id
+		uint8_t digits[ID_SEQUENCE_DIGITS];   // sequence number, most significant digit first
+		char id[ID_LENGTH];                   // current id
+		// hand the slot back when the thread exits
+		~ThreadState(){
+            if (slot >= 0) IdGenerator::Instance().Release(*this);
+        }
+	};
+
+	IdGenerator() : session(NO_SESSION), nextSlot(0){}
+
+	static uint64_t Power(size_t _digits){
+        uint64_t _power = 1;
+        for (size_t i = 0; i < _digits; ++i) _power *= ID_BASE;
+        return _power;
+    }
+	// Encode _value as _digits base-36 characters
+	static void Encode(uint64_t _value, size_t _digits, char* _out){
+        for (size_t i = _digits; i-- > 0;){
+            _out[i] = ID_ALPHABET[_value % ID_BASE];
+            _value /= ID_BASE;
+        }
+    }
+
+	ThreadState& LocalState(){
+        thread_local ThreadState _state;
+        return _state;
+    }
+	// Give a thread a slot: one handed back by an exited thread, continuing its sequence, or else a fresh one
+	void Claim(ThreadState& _state){
+        lock_guard<mutex> _lock(guard);
+        uint64_t _session = session.load(memory_order_relaxed);
+        if (_session == NO_SESSION) throw logic_error("order id session not set");
+        Encode(_session, ID_SESSION_DIGITS, _state.id);
+        char* _sequence = _state.id + ID_SESSION_DIGITS + ID_THREAD_DIGITS;
+        while (!freeSlots.empty()){
+            Slot _free = freeSlots.back();
+            freeSlots.pop_back();
+            _state.slot = _free.slot;
+            memcpy(_state.digits, _free.digits, ID_SEQUENCE_DIGITS);
+            for (size_t i = 0; i < ID_SEQUENCE_DIGITS; ++i) _sequence[i] = ID_ALPHABET[_state.digits[i]];
+            Encode(static_cast<uint64_t>(_state.slot), ID_THREAD_DIGITS, _state.id + ID_SESSION_DIGITS);
+            // a slot whose sequence has run out is retired
+            if (Increment(_state)) return;
+        }
+        if (static_cast<uint64_t>(nextSlot) >= Power(ID_THREAD_DIGITS)) throw runtime_error("order id thread slots exhausted");
+        _state.slot = nextSlot++;
+        Encode(static_cast<uint64_t>(_state.slot), ID_THREAD_DIGITS, _state.id + ID_SESSION_DIGITS);
+        memset(_state.digits, 0, ID_SEQUENCE_DIGITS);
+        Encode(0, ID_SEQUENCE_DIGITS, _sequence);
+    }
+	// Take back an exiting thread's slot
+	void Release(const ThreadState& _state){
+        Slot _free;
+        _free.slot = _state.slot;
+        memcpy(_free.digits, _state.digits, ID_SEQUENCE_DIGITS);
+        lock_guard<mutex> _lock(guard);
+        freeSlots.push_back(_free);
+    }
+	// Advance a thread's sequence by one, false once the slot is used up
+	static bool Increment(ThreadState& _state){
+        char* _sequence = _state.id + ID_SESSION_DIGITS + ID_THREAD_DIGITS;
+        for (size_t i = ID_SEQUENCE_DIGITS; i-- > 0;){
+            if (++_state.digits[i] < ID_BASE){
+                _sequence[i] = ID_ALPHABET[_state.digits[i]];
+                return true;
+            }
+            _state.digits[i] = 0;
+            _sequence[i] = ID_ALPHABET[0];
+        }
+        return false;
+    }
+
+	atomic<uint64_t> session;
+	long nextSlot;                  // slots handed out so far, guarded by guard
+	vector<Slot> freeSlots;         // slots handed back by exited threads, guarded by guard
+	mutex guard;
+};
+
+// Claim the next session from the counter kept in _path, creating it at session 0, and advance the counter.
+// The file is locked while it is read and rewritten, so runs sharing it (e.g. runs appending to the same
+// executions.txt) get distinct sessions, even concurrently, until 36^3 runs have wrapped the counter around.
+// Throws runtime_error if the file cannot be opened, read or written.
+uint64_t ClaimSession(const string& _path)
+{
+	int _fd = open(_path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (_fd < 0) throw runtime_error("Cannot open " + _path);
+	if (flock(_fd, LOCK_EX) != 0)
+	{
+		close(_fd);
+		throw runtime_error("Cannot lock " + _path);
+	}
+	char _text[32] = {};
+	ssize_t _read = pread(_fd, _text, sizeof(_text) - 1, 0);
+	uint64_t _session = (_read > 0) ? strtoull(_text, nullptr, 10) % (ID_BASE * ID_BASE * ID_BASE) : 0;
+	int _size = snprintf(_text, sizeof(_text), "%llu\n", static_cast<unsigned long long>((_session + 1) % (ID_BASE * ID_BASE * ID_BASE)));
+	bool _written = _read >= 0 && ftruncate(_fd, 0) == 0 && pwrite(_fd, _text, _size, 0) == _size && fsync(_fd) == 0;
+	close(_fd);
+	if (!_written) throw runtime_error("Cannot update " + _path);
+	return _session;
+}
+
+#endif
@@ -13,6 +13,7 @@
 
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
+#include "parallelloader.hpp"
 #include <string>
 #include <vector>
 #include <map>
@@ -25,11 +26,12 @@ class Inquiry {
 public:
     // Constructor
     Inquiry() = default;
-    Inquiry(const std::string& inquiryId, const T& product, Side side, long quantity, double price, InquiryState state)
+    Inquiry(const std::string& inquiryId, ProductHandle<T> product, Side side, long quantity, double price, InquiryState state)
         : inquiryId(inquiryId), product(product), side(side), quantity(quantity), price(price), state(state) {}
     // Getters and setters
     const std::string& GetInquiryId() const { return inquiryId; }
-    const T& GetProduct() const { return product; }
+    const T& GetProduct() const { return product.Get(); }
+    ProductHandle<T> GetProductHandle() const { return product; }
     Side GetSide() const { return side; }
     long GetQuantity() const { return quantity; }
     double GetPrice() const { return price; }
@@ -37,24 +39,39 @@ public:
     InquiryState GetState() const { return state; }
     void SetState(InquiryState newState) { state = newState; }
     std::vector<std::string> ToStrings() const {
-        return { inquiryId, product.GetProductId(), SideToString(side), std::to_string(quantity), ConvertPrice(price), StateToString(state) };
+        return { inquiryId, product.Get().GetProductId(), SideToString(side), std::to_string(quantity), ConvertPrice(price), StateToString(state) };
+    }
+    // Write the fields ToStrings() returns into _buffer
+    void WriteTo(RecordBuffer& buffer) const {
+        buffer.WriteField(inquiryId);
+        buffer.WriteField(product.Get().GetProductId());
+        buffer.WriteField(SideName(side));
+        buffer.WriteInteger(quantity);
+        buffer.WritePrice(price);
+        buffer.WriteField(StateName(state));
     }
 
 private:
     std::string inquiryId;
-    T product;
+    ProductHandle<T> product;
     Side side;
     long quantity;
     double price;
     InquiryState state;
     static std::string SideToString(Side side) {
+        return SideName(side);
+    }
+    static std::string StateToString(InquiryState state) {
+        return StateName(state);
+    }
+    static const char* SideName(Side side) {
         switch (side) {
             case BUY: return "BUY";
             case SELL: return "SELL";
             default: return "";
         }
     }
-    static std::string StateToString(InquiryState state) {
+    static const char* StateName(InquiryState state) {
         switch (state) {
             case RECEIVED: return "RECEIVED";
             case QUOTED: return "QUOTED";
@@ -183,10 +200,6 @@ template<typename T>
 class InquiryConnector: public Connector<Inquiry<T>>{
 private:
 	InquiryService<T>* service;
-    Side StringToSide(const std::string& str) {
-        if (str == "BUY") return BUY;
-        else return SELL;
-    }
 public:
 	InquiryConnector(InquiryService<T>* _service){
         // Connector and Destructor
@@ -209,32 +222,30 @@ public:
         }
     }
     // Inquiry Reading: Read inquiries from inquiries.txt and create Inquiry objects with the state RECEIVED.
+    // Each line is parsed with ParseLine() as the parallel loaders do.
     void Subscribe(std::ifstream& dataStream) {
         std::string line;
+        std::vector<Inquiry<T>> inquiries;
         while (std::getline(dataStream, line)) {
-            std::stringstream lineStream(line);
-            std::vector<std::string> cells;
-            std::string cell;
-            while (std::getline(lineStream, cell, ',')) {
-                cells.push_back(cell);
-            }
-
-            if (cells.size() < 6) {
-                // Handle error: insufficient data in line
-                continue;
-            }
-
-            std::string inquiryId = cells[0];
-            std::string productId = cells[1];
-            Side side = StringToSide(cells[2]); // Assuming StringToSide is implemented
-            long quantity = std::stol(cells[3]);
-            double price = ConvertPrice(cells[4]);
-            InquiryState state = RECEIVED; // Assuming StringToInquiryState is implemented
-            T product = GetBond(productId);
-            Inquiry<T> inquiry(inquiryId, product, side, quantity, price, state);
-            service->OnMessage(inquiry);
+            if (line.empty()) continue;
+            inquiries.clear();
+            ParseLine(line, inquiries);
+            for (auto& inquiry : inquiries) service->OnMessage(inquiry);
         }
     }
+    // Subscribe data from a file parsed on _threads threads (one per core if 0), delivering inquiries in file order
+    void SubscribeParallel(const string& _path, size_t _threads = 0) {
+        ParallelLoader<Inquiry<T>>(_threads).Load(_path, &InquiryConnector::ParseLine, [&](Inquiry<T>& _inquiry) { service->OnMessage(_inquiry); });
+    }
+    // Parse an "inquiry id,product,side,quantity,price,state" line in place, skipping lines with fewer fields
+    static void ParseLine(std::string_view _line, std::vector<Inquiry<T>>& _inquiries) {
+        std::string_view _cells[6];
+        size_t _count = 0;
+        while (!_line.empty() && _count < 6) _cells[_count++] = NextToken(_line, ',');
+        if (_count < 6) return;
+        Side _side = ParseSide(_cells[2]);
+        _inquiries.push_back(Inquiry<T>(std::string(_cells[0]), GetProductHandle<T>(_cells[1]), _side, ParseLong(_cells[3]), ConvertPrice(_cells[4]), RECEIVED));
+    }
 
 };
 
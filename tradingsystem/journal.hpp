@@ -0,0 +1,408 @@
+/**
+* journal.hpp
+* Defines a compact binary journal for historical data.
+* A journal file is a JournalHeader followed by records of one type, each prefixed by its length.
+* Each record carries a nanosecond timestamp and the product registry index instead of the product id;
+* strings and books are stored whole, so nothing is truncated.
+*
+*/
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include "soa.hpp"
+#include "riskservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "algostreamingservice.hpp"
+#include "inquiryservice.hpp"
+
+using namespace std;
+
+// Identifies a journal file and its layout version
+const char JOURNAL_MAGIC[4] = { 'T', 'S', 'J', 'L' };
+const uint16_t JOURNAL_VERSION = 2;
+
+// Kinds of record a journal can hold, one kind per file
+enum JournalRecordType : uint16_t { POSITION_RECORD = 1, PV01_RECORD, EXECUTION_RECORD, STREAMING_RECORD, INQUIRY_RECORD };
+
+/**
+* Header at the start of every journal file.
+*/
+struct JournalHeader{
+	char magic[4];
+	uint16_t version;
+	uint16_t recordType;
+	uint32_t recordSize;    // size of the fixed part of each record
+	uint32_t productCount;  // products registered when the journal was written, the on-the-run bonds then the synthetic universe
+};
+static_assert(sizeof(JournalHeader) == 16, "journal header layout");
+
+// Get the current time in nanoseconds since the epoch.
+int64_t JournalTimestamp()
+{
+	return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Format a journal timestamp the way TimeStamp() does.
+string JournalTimeString(int64_t _timestamp)
+{
+	system_clock::time_point _timePoint{duration_cast<system_clock::duration>(nanoseconds(_timestamp))};
+	return getTime(_timePoint) + " ";
+}
+
+// Append the bytes of a fixed-size value.
+template<typename R>
+void AppendBytes(RecordBuffer& _out, const R& _value)
+{
+	_out.Append(reinterpret_cast<const char*>(&_value), sizeof(_value));
+}
+
+// Append a string as its uint16_t length followed by its bytes, so it is kept whole.
+void AppendString(RecordBuffer& _out, string_view _value)
+{
+	if (_value.size() > UINT16_MAX) throw length_error("journal field longer than 65535 bytes");
+	uint16_t _size = static_cast<uint16_t>(_value.size());
+	AppendBytes(_out, _size);
+	_out.Append(_value);
+}
+
+/**
+* Reads the fields of one record body in the order they were appended.
+* Throws if the body ends before a field does.
+*/
+class JournalReader{
+public:
+	explicit JournalReader(string_view _body) : body(_body), offset(0){}
+
+	// Read a fixed-size value
+	template<typename R>
+	R Read(){
+        R _value;
+        memcpy(&_value, Take(sizeof(_value)), sizeof(_value));
+        return _value;
+    }
+	// Read a string written by AppendString()
+	string ReadString(){
+        uint16_t _size = Read<uint16_t>();
+        return string(Take(_size), _size);
+    }
+	// Whether every byte of the body has been read
+	bool AtEnd() const{
+        return offset == body.size();
+    }
+private:
+	const char* Take(size_t _size){
+        if (body.size() - offset < _size) throw runtime_error("truncated journal record");
+        const char* _bytes = body.data() + offset;
+        offset += _size;
+        return _bytes;
+    }
+
+	string_view body;
+	size_t offset;
+};
+
+/**
+* Encodes a data type to a journal record and decodes it back.
+* Specialized for every type that is persisted by a HistoricalDataService. A record body is a fixed-size Record
+* struct, starting with an int64_t timestamp and the uint32_t product registry index, followed by the
+* variable-length fields (strings, books) that do not fit a fixed layout. DecodeState is whatever a decoder
+* needs to keep between records; each JournalDecoder owns its own.
+* Type V is the data type.
+*/
+template<typename V>
+struct JournalCodec;
+
+// Nothing kept between records
+struct NoDecodeState{};
+
+/**
+* Position record: the book count, then the position and name of each book.
+*/
+struct PositionRecord{
+	int64_t timestamp;
+	uint32_t product;
+	uint32_t bookCount;
+};
+static_assert(sizeof(PositionRecord) == 16, "position record layout");
+
+template<typename T>
+struct JournalCodec<Position<T>>{
+	typedef PositionRecord Record;
+	typedef T Product;
+	// positions are decoded into a store, since a Position is a view onto one
+	typedef PositionStore<T> DecodeState;
+	static const JournalRecordType TYPE = POSITION_RECORD;
+
+	static void Encode(const Position<T>& _data, int64_t _timestamp, RecordBuffer& _out){
+        Record _record = {};
+        _record.timestamp = _timestamp;
+        _record.product = static_cast<uint32_t>(_data.GetProductHandle().GetIndex());
+        _data.ForEachBook([&](const string&, long) { _record.bookCount++; });
+        AppendBytes(_out, _record);
+        _data.ForEachBook([&](const string& _book, long _position) {
+            AppendBytes(_out, static_cast<int64_t>(_position));
+            AppendString(_out, _book);
+        });
+    }
+	// The position is a view onto _store, valid until the next Decode() of the same product into it
+	static Position<T> Decode(JournalReader& _reader, DecodeState& _store){
+        Record _record = _reader.Read<Record>();
+        _store.Clear(_record.product);
+        Position<T> _position(ProductHandle<T>(_record.product), _store);
+        for (uint32_t i = 0; i < _record.bookCount; ++i){
+            int64_t _quantity = _reader.Read<int64_t>();
+            _position.AddPosition(_reader.ReadString(), _quantity);
+        }
+        return _position;
+    }
+};
+
+/**
+* PV01 record.
+*/
+struct PV01Record{
+	int64_t timestamp;
+	uint32_t product;
+	uint32_t reserved;
+	double pv01;
+	int64_t quantity;
+};
+static_assert(sizeof(PV01Record) == 32, "pv01 record layout");
+
+template<typename T>
+struct JournalCodec<PV01<T>>{
+	typedef PV01Record Record;
+	typedef T Product;
+	typedef NoDecodeState DecodeState;
+	static const JournalRecordType TYPE = PV01_RECORD;
+
+	static void Encode(const PV01<T>& _data, int64_t _timestamp, RecordBuffer& _out){
+        Record _record = {};
+        _record.timestamp = _timestamp;
+        _record.product = static_cast<uint32_t>(_data.GetProductHandle().GetIndex());
+        _record.pv01 = _data.GetPV01();
+        _record.quantity = _data.GetQuantity();
+        AppendBytes(_out, _record);
+    }
+	static PV01<T> Decode(JournalReader& _reader, DecodeState&){
+        Record _record = _reader.Read<Record>();
+        return PV01<T>(ProductHandle<T>(_record.product), _record.pv01, _record.quantity);
+    }
+};
+
+/**
+* Execution order record, followed by the order id and the parent order id.
+*/
+struct ExecutionRecord{
+	int64_t timestamp;
+	uint32_t product;
+	uint8_t side;
+	uint8_t orderType;
+	uint8_t isChildOrder;
+	uint8_t reserved;
+	double price;
+	int64_t visibleQuantity;
+	int64_t hiddenQuantity;
+};
+static_assert(sizeof(ExecutionRecord) == 40, "execution record layout");
+
+template<typename T>
+struct JournalCodec<ExecutionOrder<T>>{
+	typedef ExecutionRecord Record;
+	typedef T Product;
+	typedef NoDecodeState DecodeState;
+	static const JournalRecordType TYPE = EXECUTION_RECORD;
+
+	static void Encode(const ExecutionOrder<T>& _data, int64_t _timestamp, RecordBuffer& _out){
+        Record _record = {};
+        _record.timestamp = _timestamp;
+        _record.product = static_cast<uint32_t>(_data.GetProductHandle().GetIndex());
+        _record.side = _data.GetPricingSide();
+        _record.orderType = _data.GetOrderType();
+        _record.isChildOrder = _data.IsChildOrder();
+        _record.price = _data.GetPrice();
+        _record.visibleQuantity = _data.GetVisibleQuantity();
+        _record.hiddenQuantity = _data.GetHiddenQuantity();
+        AppendBytes(_out, _record);
+        AppendString(_out, _data.GetOrderId());
+        AppendString(_out, _data.GetParentOrderId());
+    }
+	static ExecutionOrder<T> Decode(JournalReader& _reader, DecodeState&){
+        Record _record = _reader.Read<Record>();
+        string _orderId = _reader.ReadString();
+        string _parentOrderId = _reader.ReadString();
+        return ExecutionOrder<T>(ProductHandle<T>(_record.product), static_cast<PricingSide>(_record.side), _orderId,
+                                 static_cast<OrderType>(_record.orderType), _record.price, _record.visibleQuantity, _record.hiddenQuantity,
+                                 _parentOrderId, _record.isChildOrder != 0);
+    }
+};
+
+/**
+* Price stream record: the bid and offer orders.
+*/
+struct StreamingRecord{
+	int64_t timestamp;
+	uint32_t product;
+	uint32_t reserved;
+	double bidPrice;
+	int64_t bidVisibleQuantity;
+	int64_t bidHiddenQuantity;
+	double offerPrice;
+	int64_t offerVisibleQuantity;
+	int64_t offerHiddenQuantity;
+};
+static_assert(sizeof(StreamingRecord) == 64, "streaming record layout");
+
+template<typename T>
+struct JournalCodec<PriceStream<T>>{
+	typedef StreamingRecord Record;
+	typedef T Product;
+	typedef NoDecodeState DecodeState;
+	static const JournalRecordType TYPE = STREAMING_RECORD;
+
+	static void Encode(const PriceStream<T>& _data, int64_t _timestamp, RecordBuffer& _out){
+        Record _record = {};
+        _record.timestamp = _timestamp;
+        _record.product = static_cast<uint32_t>(_data.GetProductHandle().GetIndex());
+        _record.bidPrice = _data.GetBidOrder().GetPrice();
+        _record.bidVisibleQuantity = _data.GetBidOrder().GetVisibleQuantity();
+        _record.bidHiddenQuantity = _data.GetBidOrder().GetHiddenQuantity();
+        _record.offerPrice = _data.GetOfferOrder().GetPrice();
+        _record.offerVisibleQuantity = _data.GetOfferOrder().GetVisibleQuantity();
+        _record.offerHiddenQuantity = _data.GetOfferOrder().GetHiddenQuantity();
+        AppendBytes(_out, _record);
+    }
+	static PriceStream<T> Decode(JournalReader& _reader, DecodeState&){
+        Record _record = _reader.Read<Record>();
+        PriceStreamOrder _bid(_record.bidPrice, _record.bidVisibleQuantity, _record.bidHiddenQuantity, BID);
+        PriceStreamOrder _offer(_record.offerPrice, _record.offerVisibleQuantity, _record.offerHiddenQuantity, OFFER);
+        return PriceStream<T>(ProductHandle<T>(_record.product), _bid, _offer);
+    }
+};
+
+/**
+* Inquiry record, followed by the inquiry id.
+*/
+struct InquiryRecord{
+	int64_t timestamp;
+	uint32_t product;
+	uint8_t side;
+	uint8_t state;
+	uint16_t reserved;
+	double price;
+	int64_t quantity;
+};
+static_assert(sizeof(InquiryRecord) == 32, "inquiry record layout");
+
+template<typename T>
+struct JournalCodec<Inquiry<T>>{
+	typedef InquiryRecord Record;
+	typedef T Product;
+	typedef NoDecodeState DecodeState;
+	static const JournalRecordType TYPE = INQUIRY_RECORD;
+
+	static void Encode(const Inquiry<T>& _data, int64_t _timestamp, RecordBuffer& _out){
+        Record _record = {};
+        _record.timestamp = _timestamp;
+        _record.product = static_cast<uint32_t>(_data.GetProductHandle().GetIndex());
+        _record.side = _data.GetSide();
+        _record.state = _data.GetState();
+        _record.price = _data.GetPrice();
+        _record.quantity = _data.GetQuantity();
+        AppendBytes(_out, _record);
+        AppendString(_out, _data.GetInquiryId());
+    }
+	static Inquiry<T> Decode(JournalReader& _reader, DecodeState&){
+        Record _record = _reader.Read<Record>();
+        return Inquiry<T>(_reader.ReadString(), ProductHandle<T>(_record.product), static_cast<Side>(_record.side),
+                          _record.quantity, _record.price, static_cast<InquiryState>(_record.state));
+    }
+};
+
+// Build the header for a journal of data type V.
+template<typename V>
+JournalHeader MakeJournalHeader()
+{
+	JournalHeader _header = {};
+	memcpy(_header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+	_header.version = JOURNAL_VERSION;
+	_header.recordType = JournalCodec<V>::TYPE;
+	_header.recordSize = sizeof(typename JournalCodec<V>::Record);
+	_header.productCount = static_cast<uint32_t>(ProductRegistry<typename JournalCodec<V>::Product>::Instance().Size());
+	return _header;
+}
+
+// Append one journal record of _data: its uint32_t body length, then the body.
+template<typename V>
+void AppendJournalRecord(const V& _data, int64_t _timestamp, RecordBuffer& _out)
+{
+	size_t _start = _out.Size();
+	uint32_t _length = 0;
+	AppendBytes(_out, _length);
+	JournalCodec<V>::Encode(_data, _timestamp, _out);
+	_length = static_cast<uint32_t>(_out.Size() - _start - sizeof(_length));
+	_out.Replace(_start, reinterpret_cast<const char*>(&_length), sizeof(_length));
+}
+
+// Get the size of the journal record at the start of _bytes, length included; 0 if _bytes ends before it does.
+size_t JournalRecordSize(string_view _bytes)
+{
+	uint32_t _length;
+	if (_bytes.size() < sizeof(_length)) return 0;
+	memcpy(&_length, _bytes.data(), sizeof(_length));
+	return (_bytes.size() - sizeof(_length) < _length) ? 0 : sizeof(_length) + _length;
+}
+
+// Get the body of a journal record.
+string_view JournalRecordBody(string_view _record)
+{
+	return _record.substr(sizeof(uint32_t));
+}
+
+/**
+* Decodes journal records of data type V.
+* Keep one decoder per thread: it owns the codec's DecodeState, so what it returns may only be valid
+* until its next Decode().
+* Type V is the data type.
+*/
+template<typename V>
+class JournalDecoder{
+public:
+	// Decode a whole record (length included), throwing if it is malformed
+	V Decode(string_view _record){
+        JournalReader _reader(JournalRecordBody(_record));
+        V _data = JournalCodec<V>::Decode(_reader, state);
+        if (!_reader.AtEnd()) throw runtime_error("malformed journal record");
+        return _data;
+    }
+	// Get the timestamp of a record
+	static int64_t Timestamp(string_view _record){
+        return JournalReader(JournalRecordBody(_record)).Read<int64_t>();
+    }
+	// Whether a record names a product in the registry, so it can be decoded
+	static bool IsKnownProduct(string_view _record){
+        JournalReader _reader(JournalRecordBody(_record));
+        _reader.Read<int64_t>();
+        return _reader.Read<uint32_t>() < ProductRegistry<typename JournalCodec<V>::Product>::Instance().Size();
+    }
+	// Decode a record back to the text layout of the historical text files
+	string DecodeText(string_view _record){
+        string _line = JournalTimeString(Timestamp(_record)) + ",";
+        for (auto& s : Decode(_record).ToStrings())
+        {
+            _line += s;
+            _line += ',';
+        }
+        return _line;
+    }
+private:
+	typename JournalCodec<V>::DecodeState state;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/**
+* journaldecoder.cpp
+* Converts binary historical journals back to the text layout of positions.txt, risk.txt,
+* executions.txt, streaming.txt and allinquiries.txt for audit.
+*
+* Usage: journal_decoder <file.journal> [<file.journal> ...] > out.txt
+*/
+#include <iostream>
+#include <string>
+
+#include "soa.hpp"
+#include "mappedfile.hpp"
+#include "journal.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+// Decode every record of one journal file to cout, returning false if the file is not a valid journal
+// or a record names a product outside the registry.
+template<typename V>
+bool DecodeRecords(string_view _records, size_t _recordSize)
+{
+	if (_recordSize != sizeof(typename JournalCodec<V>::Record)) return false;
+	JournalDecoder<V> _decoder;
+	while (!_records.empty())
+	{
+		size_t _size = JournalRecordSize(_records);
+		if (_size == 0) return false;
+		string_view _record = _records.substr(0, _size);
+		if (!JournalDecoder<V>::IsKnownProduct(_record)) return false;
+		cout << _decoder.DecodeText(_record) << '\n';
+		_records.remove_prefix(_size);
+	}
+	return true;
+}
+
+// Decode one journal file to cout.
+bool DecodeJournal(const string& _path)
+{
+	MappedFile _file(_path);
+	string_view _bytes = _file.View();
+
+	JournalHeader _header;
+	if (_bytes.size() < sizeof(_header)) return false;
+	memcpy(&_header, _bytes.data(), sizeof(_header));
+	if (memcmp(_header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || _header.version != JOURNAL_VERSION) return false;
+	// rebuild the universe the writer had registered, so every record's product index resolves
+	RegisterUniverse(_header.productCount);
+
+	string_view _records = _bytes.substr(sizeof(_header));
+	switch (_header.recordType)
+	{
+		case POSITION_RECORD: return DecodeRecords<Position<Bond>>(_records, _header.recordSize);
+		case PV01_RECORD: return DecodeRecords<PV01<Bond>>(_records, _header.recordSize);
+		case EXECUTION_RECORD: return DecodeRecords<ExecutionOrder<Bond>>(_records, _header.recordSize);
+		case STREAMING_RECORD: return DecodeRecords<PriceStream<Bond>>(_records, _header.recordSize);
+		case INQUIRY_RECORD: return DecodeRecords<Inquiry<Bond>>(_records, _header.recordSize);
+	}
+	return false;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		cerr << "Usage: " << argv[0] << " <file.journal> [<file.journal> ...]" << endl;
+		return 1;
+	}
+
+	int _status = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		try
+		{
+			if (!DecodeJournal(argv[i]))
+			{
+				log(LogLevel::ERROR, string("Not a valid journal: ") + argv[i]);
+				_status = 1;
+			}
+		}
+		catch (const exception& e)
+		{
+			log(LogLevel::ERROR, e.what());
+			_status = 1;
+		}
+	}
+	cout.flush();
+	return _status;
+}
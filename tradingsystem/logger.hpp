@@ -0,0 +1,348 @@
+/**
+* logger.hpp
+* Defines an asynchronous logger. Logging threads only copy a small fixed-size record
+* (level, static format, arguments, steady-clock timestamp) into their own lock-free ring;
+* a background thread formats the records and writes them out, to cout by default.
+* Connectors hand their preformatted console output to the same thread through Write().
+*
+*/
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits>
+#include "spscqueue.hpp"
+#include "recordbuffer.hpp"
+
+using namespace std;
+using namespace chrono;
+
+enum class LogLevel {
+    INFO,
+    WARNING,
+    ERROR
+};
+
+// Most arguments one log record carries
+const size_t LOG_MAX_ARGS = 6;
+
+// Bytes of text one log record carries across all its string arguments, longer text is truncated and marked
+const size_t LOG_TEXT_SIZE = 160;
+
+// Appended to an argument whose text was truncated to fit a log record
+const char LOG_TRUNCATED_MARK[] = "...";
+
+// Records each thread's ring holds before further records are dropped
+const size_t LOG_RING_SIZE = 1024;
+
+enum LogArgType : uint8_t { LOG_INTEGER, LOG_DECIMAL, LOG_TEXT };
+
+// Guards cout, so blocks of console text written from different threads never interleave.
+mutex& ConsoleGuard()
+{
+	static mutex _guard;
+	return _guard;
+}
+
+// Write a block of text to cout in one piece, serialized with the logger and every other caller; flushes cout if _flush.
+void WriteConsole(string_view _text, bool _flush = false)
+{
+	lock_guard<mutex> _lock(ConsoleGuard());
+	cout.write(_text.data(), _text.size());
+	if (_flush) cout.flush();
+}
+
+/**
+* One log call as queued by the logging thread.
+* The format must be a string literal (or otherwise outlive the logger); each {} in it is
+* replaced by the next argument. String arguments are copied into the record.
+* A record without a format is a piece of text passed to Write(), written as it is.
+*/
+struct LogRecord{
+	int64_t timestamp;      // steady clock nanoseconds
+	const char* format;
+	LogLevel level;
+	uint8_t argCount;
+	uint8_t truncatedArg;   // index of the argument whose text was cut short, LOG_MAX_ARGS if none
+	uint16_t textSize;
+	bool continued;         // Write(): more pieces of the same text follow
+	LogArgType types[LOG_MAX_ARGS];
+	union{
+		long integer;
+		double decimal;
+		struct{ uint16_t offset; uint16_t size; } text;
+	} args[LOG_MAX_ARGS];
+	char text[LOG_TEXT_SIZE];
+};
+
+/**
+* Process-wide asynchronous logger.
+* Log() is lock-free: each thread registers a single-producer ring on its first call and pushes into it.
+* When a ring is full the record is dropped and counted rather than blocking the caller.
+*/
+class Logger{
+public:
+	// Get the logger
+	static Logger& Instance(){
+        static Logger _logger;
+        return _logger;
+    }
+	Logger(const Logger&) = delete;
+	Logger& operator=(const Logger&) = delete;
+
+	// Queue a message built from _format and _args
+	template<typename... Args>
+	void Log(LogLevel _level, const char* _format, const Args&... _args){
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+        LogRecord _record;
+        _record.timestamp = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        _record.format = _format;
+        _record.level = _level;
+        _record.argCount = 0;
+        _record.truncatedArg = LOG_MAX_ARGS;
+        _record.textSize = 0;
+        _record.continued = false;
+        (AddArg(_record, _args), ...);
+
+        if (LocalRing().TryPush(_record)) logged.fetch_add(1, memory_order_release);
+        else dropped.fetch_add(1, memory_order_relaxed);
+    }
+	// Queue a block of text to be written as it is, without a time stamp or level (e.g. a connector's console output).
+	// Unlike Log() nothing is dropped: while the calling thread's ring is full it wakes the logger and waits for room.
+	void Write(string_view _text){
+        SPSCQueue<LogRecord>& _ring = LocalRing();
+        int64_t _timestamp = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        while (!_text.empty()){
+            LogRecord _record;
+            _record.timestamp = _timestamp;
+            _record.format = nullptr;
+            _record.level = LogLevel::INFO;
+            _record.argCount = 0;
+            _record.truncatedArg = LOG_MAX_ARGS;
+            _record.textSize = static_cast<uint16_t>(min(_text.size(), LOG_TEXT_SIZE));
+            memcpy(_record.text, _text.data(), _record.textSize);
+            _text.remove_prefix(_record.textSize);
+            _record.continued = !_text.empty();
+            if (!_ring.TryPush(_record)){
+                // ask the logger to drain now rather than at its next tick, then wait for room
+                {
+                    lock_guard<mutex> _lock(guard);
+                    flushRequested = true;
+                }
+                wake.notify_one();
+                while (!_ring.TryPush(_record)) this_thread::yield();
+            }
+            logged.fetch_add(1, memory_order_release);
+        }
+    }
+	// Wait until every record queued before the call has been written
+	void Flush(){
+        long _target = logged.load(memory_order_acquire);
+        unique_lock<mutex> _lock(guard);
+        flushRequested = true;
+        wake.notify_one();
+        done.wait(_lock, [&]() { return written >= _target; });
+    }
+	// Redirect the output, cout (through WriteConsole) when _output is stdout
+	void SetOutput(FILE* _output){
+        Flush();
+        lock_guard<mutex> _lock(guard);
+        output = _output;
+    }
+	// Get the number of records dropped because a ring was full
+	long GetDropped() const{
+        return dropped.load(memory_order_relaxed);
+    }
+	// dtor writing out everything queued
+	~Logger(){
+        {
+            lock_guard<mutex> _lock(guard);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+private:
+	Logger() : output(stdout), logged(0), dropped(0), written(0), stopping(false), flushRequested(false){
+        // map steady clock readings back to wall-clock time when formatting
+        systemOffset = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count()
+                     - duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        worker = thread(&Logger::Run, this);
+    }
+
+	// Add one argument to a record
+	template<typename A>
+	static void AddArg(LogRecord& _record, const A& _arg){
+        uint8_t i = _record.argCount++;
+        if constexpr (is_integral<A>::value){
+            _record.types[i] = LOG_INTEGER;
+            _record.args[i].integer = static_cast<long>(_arg);
+        }
+        else if constexpr (is_floating_point<A>::value){
+            _record.types[i] = LOG_DECIMAL;
+            _record.args[i].decimal = static_cast<double>(_arg);
+        }
+        else{
+            string_view _text(_arg);
+            size_t _size = min(_text.size(), LOG_TEXT_SIZE - _record.textSize);
+            if (_size < _text.size() && _record.truncatedArg == LOG_MAX_ARGS) _record.truncatedArg = i;
+            memcpy(_record.text + _record.textSize, _text.data(), _size);
+            _record.types[i] = LOG_TEXT;
+            _record.args[i].text.offset = _record.textSize;
+            _record.args[i].text.size = static_cast<uint16_t>(_size);
+            _record.textSize += static_cast<uint16_t>(_size);
+        }
+    }
+
+	// Get the calling thread's ring, registering it on first use
+	SPSCQueue<LogRecord>& LocalRing(){
+        thread_local shared_ptr<SPSCQueue<LogRecord>> _ring = Register();
+        return *_ring;
+    }
+	shared_ptr<SPSCQueue<LogRecord>> Register(){
+        auto _ring = make_shared<SPSCQueue<LogRecord>>(LOG_RING_SIZE);
+        lock_guard<mutex> _lock(guard);
+        rings.push_back(_ring);
+        return _ring;
+    }
+
+	// Background loop: drain every ring, order the records by time, format and write them
+	void Run(){
+        vector<LogRecord> _batch;
+        RecordBuffer _output(1 << 16);
+        TimeStampFormatter _formatter;
+        long _droppedReported = 0;
+        while (true){
+            vector<shared_ptr<SPSCQueue<LogRecord>>> _rings;
+            bool _stopping;
+            {
+                unique_lock<mutex> _lock(guard);
+                wake.wait_for(_lock, milliseconds(10), [&]() { return stopping || flushRequested; });
+                flushRequested = false;
+                _stopping = stopping;
+                // forget rings whose thread has exited once they are empty
+                rings.erase(remove_if(rings.begin(), rings.end(), [](const shared_ptr<SPSCQueue<LogRecord>>& r) {
+                    return r.use_count() == 1 && r->Size() == 0;
+                }), rings.end());
+                _rings = rings;
+            }
+
+            long _target = logged.load(memory_order_acquire);
+            _batch.clear();
+            LogRecord _record;
+            for (auto& r : _rings){
+                while (r->TryPop(_record)) _batch.push_back(_record);
+                // take the rest of a Write() already started, so its text is never split between two writes
+                while (!_batch.empty() && _batch.back().continued){
+                    if (r->TryPop(_record)) _batch.push_back(_record);
+                    else this_thread::yield();
+                }
+            }
+            // stable, so the pieces of one Write() stay together and in order
+            stable_sort(_batch.begin(), _batch.end(), [](const LogRecord& a, const LogRecord& b) { return a.timestamp < b.timestamp; });
+
+            _output.Clear();
+            for (auto& r : _batch) Format(r, _formatter, _output);
+            long _dropped = dropped.load(memory_order_relaxed);
+            if (_dropped > _droppedReported){
+                LogRecord _warning;
+                _warning.timestamp = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+                _warning.format = "{} log records dropped";
+                _warning.level = LogLevel::WARNING;
+                _warning.argCount = 0;
+                _warning.truncatedArg = LOG_MAX_ARGS;
+                _warning.textSize = 0;
+                _warning.continued = false;
+                AddArg(_warning, _dropped - _droppedReported);
+                Format(_warning, _formatter, _output);
+                _droppedReported = _dropped;
+            }
+            {
+                lock_guard<mutex> _lock(guard);
+                if (_output.Size() > 0){
+                    // stdout goes through cout under the console lock, so log lines stay ordered with the connectors' output
+                    if (output == stdout) WriteConsole(string_view(_output.Data(), _output.Size()), true);
+                    else{
+                        fwrite(_output.Data(), 1, _output.Size(), output);
+                        fflush(output);
+                    }
+                }
+                written = max(written, _target);
+            }
+            done.notify_all();
+            if (_stopping) return;
+        }
+    }
+
+	// Format one record as "time [LEVEL] message", or copy the text of one written with Write()
+	void Format(const LogRecord& _record, TimeStampFormatter& _formatter, RecordBuffer& _output){
+        if (!_record.format){
+            _output.Append(_record.text, _record.textSize);
+            return;
+        }
+        char _stamp[TIMESTAMP_BUFFER_SIZE];
+        _output.Append(_stamp, _formatter.Format(_record.timestamp + systemOffset, _stamp));
+        switch (_record.level){
+            case LogLevel::INFO: _output.Append(" [INFO] "); break;
+            case LogLevel::WARNING: _output.Append(" [WARNING] "); break;
+            case LogLevel::ERROR: _output.Append(" [ERROR] "); break;
+        }
+
+        size_t _arg = 0;
+        for (const char* _p = _record.format; *_p; ++_p){
+            if (_p[0] == '{' && _p[1] == '}' && _arg < _record.argCount){
+                char _digits[64];
+                switch (_record.types[_arg]){
+                    case LOG_INTEGER:
+                        _output.Append(_digits, snprintf(_digits, sizeof(_digits), "%ld", _record.args[_arg].integer));
+                        break;
+                    case LOG_DECIMAL:
+                        _output.Append(_digits, snprintf(_digits, sizeof(_digits), "%g", _record.args[_arg].decimal));
+                        break;
+                    case LOG_TEXT:
+                        _output.Append(_record.text + _record.args[_arg].text.offset, _record.args[_arg].text.size);
+                        if (_arg == _record.truncatedArg) _output.Append(LOG_TRUNCATED_MARK);
+                        break;
+                }
+                _arg++;
+                _p++;
+            }
+            else{
+                _output.Append(*_p);
+            }
+        }
+        _output.Append('\n');
+    }
+
+	FILE* output;
+	int64_t systemOffset;                               // wall clock minus steady clock, in nanoseconds
+	vector<shared_ptr<SPSCQueue<LogRecord>>> rings;     // one per logging thread
+	atomic<long> logged;                                // records queued
+	atomic<long> dropped;                               // records dropped on a full ring
+	long written;                                       // records written, guarded by guard
+	bool stopping;
+	bool flushRequested;
+	mutex guard;
+	condition_variable wake;
+	condition_variable done;
+	thread worker;
+};
+
+// log messages with different levels, written asynchronously by the logger thread
+void log(LogLevel level, const string& message) {
+    Logger::Instance().Log(level, "{}", message);
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <map>
+#include <thread>
+#include <atomic>
 
 #include "soa.hpp"
 #include "products.hpp"
@@ -15,18 +17,80 @@
 #include "riskservice.hpp"
 #include "streamingservice.hpp"
 #include "tradebookingservice.hpp"
+#include "spscqueue.hpp"
+#include "backpressure.hpp"
+#include "shardedexecutor.hpp"
+#include "logger.hpp"
 
 using namespace std;
 
-int main()
+int main(int argc, char* argv[])
 {
+    // run the feeds one after another with --sequential, otherwise each on its own thread;
+    // persist historical data as binary journals with --journal, otherwise as text;
+    // read data generated by datagen with --data <dir>, --bonds <universe size> and --depth <book depth>;
+    // with --conflate (threaded only) streaming runs on its own thread and only sees the latest price per product;
+    // with --async historical data is persisted behind bounded edges that spill to disk rather than stall the feeds;
+    // with --parallel N each feed file is parsed on N threads (0 for one per core) and delivered in file order;
+    // with --shards N the services run on N threads, each owning the products that hash to it, and with --sequential as well
+    // the feeds run one after another and write the same records per product as the sequential single graph;
+    // with --delta each market data book is applied to the stored book as level changes, counted and logged at the end;
+    // --flush-bytes N and --flush-ms N write each historical file out once N bytes are buffered or every N milliseconds;
+    // --session N is the order id session assigned to this node and run (below 36^3), distinct per concurrent session;
+    // without it each run claims the next session from the counter in session.txt, next to the files it appends to,
+    // so the execution ids of successive runs never collide until 36^3 runs have wrapped the counter around
+    bool sequential = false;
+    bool conflate = false;
+    bool delta = false;
+    bool async = false;
+    bool parallel = false;
+    size_t parseThreads = 0;
+    size_t shards = 0;
+    PersistFormat persistFormat = TEXT;
+    string dataPath = "../data";
+    size_t bonds = bondCount;
+    int bookDepth = 5;
+    uint64_t session = 0;
+    bool sessionGiven = false;
+    FlushPolicy flushPolicy;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--sequential") sequential = true;
+        if (arg == "--journal") persistFormat = JOURNAL;
+        if (arg == "--conflate") conflate = true;
+        if (arg == "--async") async = true;
+        if (arg == "--delta") delta = true;
+        if (i + 1 < argc && arg == "--data") dataPath = argv[++i];
+        else if (i + 1 < argc && arg == "--bonds") bonds = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--depth") bookDepth = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--parallel") { parallel = true; parseThreads = stoul(argv[++i]); }
+        else if (i + 1 < argc && arg == "--shards") shards = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--flush-bytes") flushPolicy.flushBytes = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--flush-ms") flushPolicy.flushInterval = milliseconds(stol(argv[++i]));
+        else if (i + 1 < argc && arg == "--session") { session = stoull(argv[++i]); sessionGiven = true; }
+    }
+    try
+    {
+        if (!sessionGiven) session = ClaimSession("session.txt");
+        IdGenerator::Instance().SetSession(session);
+    }
+    catch (const exception& e)
+    {
+        log(LogLevel::ERROR, string("No order id session: ") + e.what());
+        return 1;
+    }
+    Logger::Instance().Log(LogLevel::INFO, "Order id session {}.", static_cast<long>(session));
+    // the whole universe is registered before any service sizes its tables
+    RegisterUniverse(bonds);
+
     // 1. define data path and generate data
     log(LogLevel::INFO, "Generating price and orderbook data...");
 
-    string prices_path = "../data/prices.txt";
-    string trades_path = "../data/trades.txt";
-    string marketdata_path = "../data/marketdata.txt";
-    string inquiries_path = "../data/inquiries.txt";
+    string prices_path = dataPath + "/prices.txt";
+    string trades_path = dataPath + "/trades.txt";
+    string marketdata_path = dataPath + "/marketdata.txt";
+    string inquiries_path = dataPath + "/inquiries.txt";
 
     // 2. start trading service
     log(LogLevel::INFO, "Initializing trading service...");
@@ -41,54 +105,276 @@ int main()
 	ExecutionService<Bond> executionService;
 	StreamingService<Bond> streamingService;
 	InquiryService<Bond> inquiryService;
-	HistoricalDataService<Position<Bond>> historicalPositionService(POSITION);
-	HistoricalDataService<PV01<Bond>> historicalRiskService(RISK);
-	HistoricalDataService<ExecutionOrder<Bond>> historicalExecutionService(EXECUTION);
-	HistoricalDataService<PriceStream<Bond>> historicalStreamingService(STREAMING);
-	HistoricalDataService<Inquiry<Bond>> historicalInquiryService(INQUIRY);
+	HistoricalDataService<Position<Bond>> historicalPositionService(POSITION, persistFormat, flushPolicy);
+	HistoricalDataService<PV01<Bond>> historicalRiskService(RISK, persistFormat, flushPolicy);
+	HistoricalDataService<ExecutionOrder<Bond>> historicalExecutionService(EXECUTION, persistFormat, flushPolicy);
+	HistoricalDataService<PriceStream<Bond>> historicalStreamingService(STREAMING, persistFormat, flushPolicy);
+	HistoricalDataService<Inquiry<Bond>> historicalInquiryService(INQUIRY, persistFormat, flushPolicy);
+	marketDataService.SetBookDepth(bookDepth);
+	LevelChangeCounter<Bond> levelChanges;
+	if (delta)
+	{
+		marketDataService.GetConnector()->SetMode(DELTA);
+		marketDataService.AddLevelListener(&levelChanges);
+	}
     log(LogLevel::INFO, "Trading service Initialized.");
 
     // 3. link services
     log(LogLevel::INFO, "Linking services...");
-	pricingService.AddListener(algoStreamingService.GetListener());
+	ConflatingListener<Price<Bond>> priceConflation;
+	conflate = conflate && !sequential;
+	if (conflate) pricingService.AddListener(&priceConflation);
+	else pricingService.AddListener(algoStreamingService.GetListener());
 	pricingService.AddListener(guiService.GetListener());
 	algoStreamingService.AddListener(streamingService.GetListener());
-	streamingService.AddListener(historicalStreamingService.GetListener());
 	marketDataService.AddListener(algoExecutionService.GetListener());
 	algoExecutionService.AddListener(executionService.GetListener());
-	executionService.AddListener(tradeBookingService.GetListener());
-	executionService.AddListener(historicalExecutionService.GetListener());
 	tradeBookingService.AddListener(positionService.GetListener());
 	positionService.AddListener(riskService.GetListener());
+	// positions are views on the position service's store, so they are always persisted in line
 	positionService.AddListener(historicalPositionService.GetListener());
-	riskService.AddListener(historicalRiskService.GetListener());
-	inquiryService.AddListener(historicalInquiryService.GetListener());
+	unique_ptr<BoundedEdge<PriceStream<Bond>>> streamingEdge;
+	unique_ptr<BoundedEdge<ExecutionOrder<Bond>>> executionEdge;
+	unique_ptr<BoundedEdge<PV01<Bond>>> riskEdge;
+	unique_ptr<BoundedEdge<Inquiry<Bond>>> inquiryEdge;
+	// consumers of every product, which the shards share
+	ShardSinks<Bond> shardSinks;
+	shardSinks.prices = guiService.GetListener();
+	shardSinks.positions = historicalPositionService.GetListener();
+	if (async)
+	{
+		streamingEdge = make_unique<BoundedEdge<PriceStream<Bond>>>("streaming", historicalStreamingService.GetListener(), SPILL, 1024);
+		executionEdge = make_unique<BoundedEdge<ExecutionOrder<Bond>>>("executions", historicalExecutionService.GetListener(), SPILL, 1024);
+		riskEdge = make_unique<BoundedEdge<PV01<Bond>>>("risk", historicalRiskService.GetListener(), SPILL, 1024);
+		inquiryEdge = make_unique<BoundedEdge<Inquiry<Bond>>>("inquiries", historicalInquiryService.GetListener(), SPILL, 1024);
+		streamingService.AddListener(streamingEdge.get());
+		executionService.AddListener(executionEdge.get());
+		riskService.AddListener(riskEdge.get());
+		inquiryService.AddListener(inquiryEdge.get());
+		shardSinks.streams = streamingEdge.get();
+		shardSinks.executions = executionEdge.get();
+		shardSinks.risk = riskEdge.get();
+		shardSinks.inquiries = inquiryEdge.get();
+	}
+	else
+	{
+		streamingService.AddListener(historicalStreamingService.GetListener());
+		executionService.AddListener(historicalExecutionService.GetListener());
+		riskService.AddListener(historicalRiskService.GetListener());
+		inquiryService.AddListener(historicalInquiryService.GetListener());
+		shardSinks.streams = historicalStreamingService.GetListener();
+		shardSinks.executions = historicalExecutionService.GetListener();
+		shardSinks.risk = historicalRiskService.GetListener();
+		shardSinks.inquiries = historicalInquiryService.GetListener();
+	}
+	vector<BucketedSector<Bond>> sectors = {
+		BucketedSector<Bond>({ GetBond("9128283H1"), GetBond("9128283L2") }, "FrontEnd"),
+		BucketedSector<Bond>({ GetBond("912828M80"), GetBond("9128283J7"), GetBond("9128283F5") }, "Belly"),
+		BucketedSector<Bond>({ GetBond("912810TW8"), GetBond("912810RZ3") }, "LongEnd")
+	};
+	for (auto& sector : sectors) riskService.RegisterSector(sector);
     log(LogLevel::INFO, "Services linked.");
 
-    // 4. start Price data service
-    log(LogLevel::INFO, "Price data Retrieving .");
-	ifstream priceData(prices_path);
-	pricingService.GetConnector()->Subscribe(priceData);
-
-	log(LogLevel::INFO, "Price data Retrieved.");
-
-    // 5. start Trade data service
-    log(LogLevel::INFO, "Trade data Retrieving .");
-	ifstream tradeData(trades_path);
-	tradeBookingService.GetConnector()->Subscribe(tradeData);
-	log(LogLevel::INFO, "Trade data Retrieved.");
-
-    // 6. start Market data service
-    log(LogLevel::INFO, "Market data Retrieving .");
-	ifstream marketData(marketdata_path);
-	marketDataService.GetConnector()->Subscribe(marketData);
-	log(LogLevel::INFO, "Market data Retrieved.");
-
-    // 7. start Inquiry data service
-    log(LogLevel::INFO, "Inquiry data Retrieving .");
-	ifstream inquiryData(inquiries_path);
-	inquiryService.GetConnector()->Subscribe(inquiryData);
-    log(LogLevel::INFO, "Inquiry data Retrieved.");
+    // a feed whose file cannot be opened, read or parsed is logged and the run finishes without the rest of it, failing at exit;
+    // feed() returns whether the feed was read to the end
+    atomic<bool> fed(true);
+    auto feed = [&](const char* _name, auto _subscribe) {
+        try { _subscribe(); return true; }
+        catch (const exception& e) { Logger::Instance().Log(LogLevel::ERROR, "{} data not read: {}", _name, e.what()); fed = false; return false; }
+    };
+    // open a feed file read line by line, throwing as the mapped and parallel paths do if it cannot be opened
+    auto open = [](const string& _path) {
+        ifstream _file(_path);
+        if (!_file.is_open()) throw runtime_error("Cannot open " + _path);
+        return _file;
+    };
+
+    if (shards > 0)
+    {
+        // every service runs on the shard owning the product; the feed threads only parse and route
+        ShardedServiceGraph<Bond> graph(shards, shardSinks, bookDepth);
+        for (auto& sector : sectors) graph.RegisterSector(sector);
+        vector<LevelChangeCounter<Bond>> shardLevelChanges(graph.GetShards());
+        for (size_t s = 0; delta && s < graph.GetShards(); ++s)
+        {
+            graph.GetShard(s).marketData.GetConnector()->SetMode(DELTA);
+            graph.GetShard(s).marketData.AddLevelListener(&shardLevelChanges[s]);
+        }
+        size_t feedParseThreads = parallel ? parseThreads : 1;
+        graph.Start();
+        log(LogLevel::INFO, "Starting feeds.");
+        if (sequential)
+        {
+            bool priceFed = feed("Price", [&]() { graph.FeedPrices(prices_path, feedParseThreads); });
+            graph.Settle();
+            if (priceFed) log(LogLevel::INFO, "Price data Retrieved.");
+            bool tradeFed = feed("Trade", [&]() { graph.FeedTrades(trades_path, feedParseThreads); });
+            graph.Settle();
+            if (tradeFed) log(LogLevel::INFO, "Trade data Retrieved.");
+            bool marketFed = feed("Market", [&]() { graph.FeedMarketData(marketdata_path, feedParseThreads); });
+            graph.Settle();
+            if (marketFed) log(LogLevel::INFO, "Market data Retrieved.");
+            if (feed("Inquiry", [&]() { graph.FeedInquiries(inquiries_path, feedParseThreads); })) log(LogLevel::INFO, "Inquiry data Retrieved.");
+        }
+        else
+        {
+            thread priceThread([&]() { if (feed("Price", [&]() { graph.FeedPrices(prices_path, feedParseThreads); })) log(LogLevel::INFO, "Price data Retrieved."); });
+            thread tradeThread([&]() { if (feed("Trade", [&]() { graph.FeedTrades(trades_path, feedParseThreads); })) log(LogLevel::INFO, "Trade data Retrieved."); });
+            thread marketDataThread([&]() { if (feed("Market", [&]() { graph.FeedMarketData(marketdata_path, feedParseThreads); })) log(LogLevel::INFO, "Market data Retrieved."); });
+            thread inquiryThread([&]() { if (feed("Inquiry", [&]() { graph.FeedInquiries(inquiries_path, feedParseThreads); })) log(LogLevel::INFO, "Inquiry data Retrieved."); });
+            priceThread.join();
+            tradeThread.join();
+            marketDataThread.join();
+            inquiryThread.join();
+        }
+        graph.Join();
+        for (size_t s = 0; s < graph.GetShards(); ++s)
+            Logger::Instance().Log(LogLevel::INFO, "Shard {} processed {} events.", s, graph.GetProcessed()[s]);
+        for (size_t s = 0; delta && s < graph.GetShards(); ++s)
+            Logger::Instance().Log(LogLevel::INFO, "Shard {} market data deltas: {} levels added, {} modified, {} removed.",
+                                   s, shardLevelChanges[s].GetAdded(), shardLevelChanges[s].GetModified(), shardLevelChanges[s].GetRemoved());
+        for (size_t i = 0; i < sectors.size(); ++i)
+            Logger::Instance().Log(LogLevel::INFO, "Bucketed risk {}: {}", sectors[i].GetName(), graph.GetBucketedRisk(i));
+    }
+    else if (sequential)
+    {
+        executionService.AddListener(tradeBookingService.GetListener());
+        // 4. start Price data service
+        log(LogLevel::INFO, "Price data Retrieving .");
+        bool priceFed = feed("Price", [&]() {
+            if (parallel) pricingService.GetConnector()->SubscribeParallel(prices_path, parseThreads);
+            else { ifstream priceData = open(prices_path); pricingService.GetConnector()->Subscribe(priceData); }
+        });
+
+        if (priceFed) log(LogLevel::INFO, "Price data Retrieved.");
+
+        // 5. start Trade data service
+        log(LogLevel::INFO, "Trade data Retrieving .");
+        bool tradeFed = feed("Trade", [&]() {
+            if (parallel) tradeBookingService.GetConnector()->SubscribeParallel(trades_path, parseThreads);
+            else { ifstream tradeData = open(trades_path); tradeBookingService.GetConnector()->Subscribe(tradeData); }
+        });
+        if (tradeFed) log(LogLevel::INFO, "Trade data Retrieved.");
+
+        // 6. start Market data service
+        log(LogLevel::INFO, "Market data Retrieving .");
+        bool marketFed = feed("Market", [&]() {
+            if (parallel) marketDataService.GetConnector()->SubscribeParallel(marketdata_path, parseThreads);
+            else marketDataService.GetConnector()->SubscribeMapped(marketdata_path);
+        });
+        if (marketFed) log(LogLevel::INFO, "Market data Retrieved.");
+
+        // 7. start Inquiry data service
+        log(LogLevel::INFO, "Inquiry data Retrieving .");
+        bool inquiryFed = feed("Inquiry", [&]() {
+            if (parallel) inquiryService.GetConnector()->SubscribeParallel(inquiries_path, parseThreads);
+            else { ifstream inquiryData = open(inquiries_path); inquiryService.GetConnector()->Subscribe(inquiryData); }
+        });
+        if (inquiryFed) log(LogLevel::INFO, "Inquiry data Retrieved.");
+    }
+    else
+    {
+        // Trades from the trade feed and from executions are handed to a single owner thread
+        // through lock-free single-producer/single-consumer rings, so trade booking, positions
+        // and risk are only ever touched by that thread and need no locks.
+        SPSCQueue<Trade<Bond>> bookedTrades(1024);
+        SPSCQueue<ExecutionOrder<Bond>> executedOrders(1024);
+        QueueListener<Trade<Bond>> tradeFeedToOwner(bookedTrades);
+        QueueListener<ExecutionOrder<Bond>> executionToOwner(executedOrders);
+        executionService.AddListener(&executionToOwner);
+
+        log(LogLevel::INFO, "Starting feeds.");
+        thread ownerThread([&]() {
+            Trade<Bond> trade;
+            ExecutionOrder<Bond> order;
+            while (!(bookedTrades.Drained() && executedOrders.Drained()))
+            {
+                bool idle = true;
+                while (bookedTrades.TryPop(trade)) { tradeBookingService.OnMessage(trade); idle = false; }
+                while (executedOrders.TryPop(order)) { tradeBookingService.GetListener()->ProcessAdd(order); idle = false; }
+                if (idle) this_thread::yield();
+            }
+            log(LogLevel::INFO, "Positions and risk up to date.");
+        });
+        thread priceThread([&]() {
+            bool priceFed = feed("Price", [&]() {
+                if (parallel) pricingService.GetConnector()->SubscribeParallel(prices_path, parseThreads);
+                else { ifstream priceData = open(prices_path); pricingService.GetConnector()->Subscribe(priceData); }
+            });
+            priceConflation.Close();
+            if (priceFed) log(LogLevel::INFO, "Price data Retrieved.");
+        });
+        thread streamThread([&]() {
+            if (!conflate) return;
+            while (!priceConflation.Drained()) priceConflation.WaitAndDrain(*algoStreamingService.GetListener());
+            Logger::Instance().Log(LogLevel::INFO, "Price streams up to date: {} prices, {} conflated.",
+                                   priceConflation.GetReceived(), priceConflation.GetConflated());
+        });
+        thread tradeThread([&]() {
+            bool tradeFed = feed("Trade", [&]() {
+                if (parallel) tradeBookingService.GetConnector()->SubscribeParallel(trades_path, tradeFeedToOwner, parseThreads);
+                else { ifstream tradeData = open(trades_path); tradeBookingService.GetConnector()->Subscribe(tradeData, tradeFeedToOwner); }
+            });
+            bookedTrades.Close();
+            if (tradeFed) log(LogLevel::INFO, "Trade data Retrieved.");
+        });
+        thread marketDataThread([&]() {
+            bool marketFed = feed("Market", [&]() {
+                if (parallel) marketDataService.GetConnector()->SubscribeParallel(marketdata_path, parseThreads);
+                else marketDataService.GetConnector()->SubscribeMapped(marketdata_path);
+            });
+            executedOrders.Close();
+            if (marketFed) log(LogLevel::INFO, "Market data Retrieved.");
+        });
+        thread inquiryThread([&]() {
+            bool inquiryFed = feed("Inquiry", [&]() {
+                if (parallel) inquiryService.GetConnector()->SubscribeParallel(inquiries_path, parseThreads);
+                else { ifstream inquiryData = open(inquiries_path); inquiryService.GetConnector()->Subscribe(inquiryData); }
+            });
+            if (inquiryFed) log(LogLevel::INFO, "Inquiry data Retrieved.");
+        });
+
+        priceThread.join();
+        streamThread.join();
+        tradeThread.join();
+        marketDataThread.join();
+        inquiryThread.join();
+        ownerThread.join();
+    }
+
+    if (delta && shards == 0)
+        Logger::Instance().Log(LogLevel::INFO, "Market data deltas: {} levels added, {} modified, {} removed.",
+                               levelChanges.GetAdded(), levelChanges.GetModified(), levelChanges.GetRemoved());
+
+    // 8. forward what the edges still hold, then a durability barrier on everything persisted
+    EdgeMonitor::Instance().Report();
+    streamingEdge.reset();
+    executionEdge.reset();
+    riskEdge.reset();
+    inquiryEdge.reset();
+    // a failed write is sticky in its file's writer and reported here; sync every file anyway and fail the run
+    bool persisted = true;
+    auto sync = [&](auto* connector) {
+        try { connector->Sync(); }
+        catch (const exception& e) { log(LogLevel::ERROR, e.what()); persisted = false; }
+    };
+    sync(historicalPositionService.GetConnector());
+    sync(historicalRiskService.GetConnector());
+    sync(historicalExecutionService.GetConnector());
+    sync(historicalStreamingService.GetConnector());
+    sync(historicalInquiryService.GetConnector());
+    sync(guiService.GetConnector());
+    if (!persisted)
+    {
+        log(LogLevel::ERROR, "Historical data not persisted: Program Ended.");
+        return 1;
+    }
+    log(LogLevel::INFO, "Historical data persisted.");
+    if (!fed)
+    {
+        log(LogLevel::ERROR, "Input data not fully read: Program Ended.");
+        return 1;
+    }
 
 	log(LogLevel::INFO, "Program Ended.");
 	return 0;
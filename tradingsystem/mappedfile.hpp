@@ -0,0 +1,91 @@
+/**
+* mappedfile.hpp
+* Defines a read-only memory-mapped file and helpers to parse fields in place from it.
+*
+*/
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <stdexcept>
+#include <charconv>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+* A whole file mapped read-only into memory.
+* The mapping lives as long as the object, so views handed out by View() must not outlive it.
+*/
+class MappedFile{
+public:
+	// ctor and dtor
+	explicit MappedFile(const string& _path) : data(nullptr), size(0){
+        int _fd = open(_path.c_str(), O_RDONLY);
+        if (_fd < 0) throw runtime_error("Cannot open " + _path);
+
+        struct stat _stat;
+        if (fstat(_fd, &_stat) < 0){
+            close(_fd);
+            throw runtime_error("Cannot stat " + _path);
+        }
+        size = _stat.st_size;
+
+        if (size > 0){
+            void* _addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (_addr == MAP_FAILED){
+                close(_fd);
+                throw runtime_error("Cannot map " + _path);
+            }
+            madvise(_addr, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(_addr);
+        }
+        close(_fd);
+    }
+	~MappedFile(){
+        if (data) munmap(const_cast<char*>(data), size);
+    }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Get the size of the file in bytes
+	size_t Size() const{ return size; }
+	// Get a view over the whole file
+	string_view View() const{ return string_view(data, size); }
+private:
+	const char* data;
+	size_t size;
+};
+
+// Split the next token off the front of _text at _delimiter, advancing _text past it.
+string_view NextToken(string_view& _text, char _delimiter)
+{
+	const char* _begin = _text.data();
+	const char* _end = static_cast<const char*>(memchr(_begin, _delimiter, _text.size()));
+	if (!_end)
+	{
+		string_view _token = _text;
+		_text = string_view();
+		return _token;
+	}
+	string_view _token(_begin, _end - _begin);
+	_text.remove_prefix(_token.size() + 1);
+	return _token;
+}
+
+// Parse a long from a field without allocating; throws invalid_argument unless the whole field is an integer.
+long ParseLong(string_view _field)
+{
+	long _value = 0;
+	const char* _last = _field.data() + _field.size();
+	from_chars_result _result = from_chars(_field.data(), _last, _value);
+	if (_result.ec != errc() || _result.ptr != _last) throw invalid_argument("Invalid integer " + string(_field));
+	return _value;
+}
+
+#endif
@@ -9,12 +9,25 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include "soa.hpp"
 #include "products.hpp"
 #include "functions.hpp"
+#include "mappedfile.hpp"
+#include "parallelloader.hpp"
+#include "logger.hpp"
 
 using namespace std;
 enum PricingSide { BID, OFFER }; // Side for market data
+
+// Parse a market data side; throws invalid_argument unless the field is BID or OFFER.
+PricingSide ParsePricingSide(string_view _field)
+{
+	if (_field == "BID") return BID;
+	if (_field == "OFFER") return OFFER;
+	throw invalid_argument("Invalid side " + string(_field));
+}
+
 /**
 * A market data order with price, quantity, and side.
 */
@@ -56,8 +69,14 @@ private:
 	Order offerOrder;
 };
 
+// What a level update did to an order book
+enum LevelChange { LEVEL_UNCHANGED, LEVEL_ADDED, LEVEL_MODIFIED, LEVEL_DELETED };
+
 /**
 * Order book with a bid and offer stack.
+* Each stack is kept sorted best level first (bids descending, offers ascending), so the
+* best bid/offer is the front of each stack and the top k levels are its first k entries.
+* Levels are added, modified and deleted in place with UpdateLevel().
 * Type T is the product type.
 */
 template<typename T>
@@ -65,56 +84,132 @@ class OrderBook{
 public:
 	// ctor for the order book
 	OrderBook() = default;
-	OrderBook(const T& _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack){
+	OrderBook(ProductHandle<T> _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack){
         product = _product;
         bidStack = _bidStack;
         offerStack = _offerStack;
+        stable_sort(bidStack.begin(), bidStack.end(), [](const Order& a, const Order& b) { return IsBetter(BID, a.GetPrice(), b.GetPrice()); });
+        stable_sort(offerStack.begin(), offerStack.end(), [](const Order& a, const Order& b) { return IsBetter(OFFER, a.GetPrice(), b.GetPrice()); });
     }
 	// Get the product
 	const T& GetProduct() const{
+        return product.Get();
+    }
+	// Get the handle onto the registered product
+	ProductHandle<T> GetProductHandle() const{
         return product;
     }
-	// Get the bid stack
+	// Get the bid stack, best level first
 	const vector<Order>& GetBidStack() const{
         return bidStack;
     }
-	// Get the offer stack
+	// Get the offer stack, best level first
 	const vector<Order>& GetOfferStack() const{
         return offerStack;
     }
-	// Get the best bid/offer order
+	// Whether both sides have at least one level, so GetBidOffer() is a real two-way market
+	bool IsTwoSided() const{
+        return !bidStack.empty() && !offerStack.empty();
+    }
+	// Get the best bid/offer order, an empty order on a side with no levels
     BidOffer GetBidOffer() const {
-        double highestBidPrice = std::numeric_limits<double>::lowest();
-        Order bestBidOrder;
-        //get the length of bidStack
-        for (const auto& order : bidStack) {
-            double price = order.GetPrice();
-            if (price > highestBidPrice) {
-                highestBidPrice = price;
-                bestBidOrder = order;
-            }
+        return BidOffer(bidStack.empty() ? Order(0, 0, BID) : bidStack.front(),
+                        offerStack.empty() ? Order(0, 0, OFFER) : offerStack.front());
+    }
+	// Get the best _levels levels of one side
+	vector<Order> GetDepth(PricingSide _side, size_t _levels) const{
+        const vector<Order>& _stack = (_side == BID) ? bidStack : offerStack;
+        return vector<Order>(_stack.begin(), _stack.begin() + min(_levels, _stack.size()));
+    }
+	// Set the quantity of the level at _price: insert it at its sorted position, modify it, or delete it when _quantity is 0
+	LevelChange UpdateLevel(PricingSide _side, double _price, long _quantity){
+        vector<Order>& _stack = (_side == BID) ? bidStack : offerStack;
+        auto it = lower_bound(_stack.begin(), _stack.end(), _price, [_side](const Order& o, double p) { return IsBetter(_side, o.GetPrice(), p); });
+        bool _found = (it != _stack.end() && it->GetPrice() == _price);
+        if (_quantity <= 0){
+            if (!_found) return LEVEL_UNCHANGED;
+            _stack.erase(it);
+            return LEVEL_DELETED;
         }
-
-        double lowestOfferPrice = std::numeric_limits<double>::max();
-        Order bestOfferOrder;
-        for (const auto& order : offerStack) {
-            double price = order.GetPrice();
-            if (price < lowestOfferPrice) {
-                lowestOfferPrice = price;
-                bestOfferOrder = order;
-            }
+        if (_found){
+            if (it->GetQuantity() == _quantity) return LEVEL_UNCHANGED;
+            *it = Order(_price, _quantity, _side);
+            return LEVEL_MODIFIED;
         }
-//        cout << "best bid price: " << bestBidOrder.GetPrice() << endl;
-//        cout << "best offer price: " << bestOfferOrder.GetPrice() << endl;
-        return BidOffer(bestBidOrder, bestOfferOrder);
+        _stack.insert(it, Order(_price, _quantity, _side));
+        return LEVEL_ADDED;
+    }
+	// Get the quantity quoted at _price on one side, 0 if there is no such level
+	long GetLevelQuantity(PricingSide _side, double _price) const{
+        const vector<Order>& _stack = (_side == BID) ? bidStack : offerStack;
+        auto it = lower_bound(_stack.begin(), _stack.end(), _price, [_side](const Order& o, double p) { return IsBetter(_side, o.GetPrice(), p); });
+        return (it != _stack.end() && it->GetPrice() == _price) ? it->GetQuantity() : 0;
+    }
+	// Merge levels quoted at the same price into one, summing their quantities
+	void AggregateLevels(){
+        AggregateLevels(bidStack);
+        AggregateLevels(offerStack);
     }
 private:
-	T product;
+	// Whether price _a is a better level than _b on _side
+	static bool IsBetter(PricingSide _side, double _a, double _b){
+        return (_side == BID) ? _a > _b : _a < _b;
+    }
+	// Merge adjacent equal-price levels of a sorted stack
+	static void AggregateLevels(vector<Order>& _stack){
+        size_t _out = 0;
+        for (size_t i = 0; i < _stack.size(); ++i){
+            if (_out > 0 && _stack[_out - 1].GetPrice() == _stack[i].GetPrice()){
+                const Order& _level = _stack[_out - 1];
+                _stack[_out - 1] = Order(_level.GetPrice(), _level.GetQuantity() + _stack[i].GetQuantity(), _level.GetSide());
+            }
+            else{
+                _stack[_out++] = _stack[i];
+            }
+        }
+        _stack.resize(_out);
+    }
+
+	ProductHandle<T> product;
 	vector<Order> bidStack;
 	vector<Order> offerStack;
 };
 
 
+/**
+* A change to one price level of a product's order book.
+* The level carries the new quantity, 0 when the level was deleted.
+* Type T is the product type.
+*/
+template<typename T>
+class LevelUpdate{
+public:
+	// ctor for a level update
+	LevelUpdate() = default;
+	LevelUpdate(ProductHandle<T> _product, const Order& _level){
+        product = _product;
+        level = _level;
+    }
+	// Get the product
+	const T& GetProduct() const{
+        return product.Get();
+    }
+	// Get the handle onto the registered product
+	ProductHandle<T> GetProductHandle() const{
+        return product;
+    }
+	// Get the changed level
+	const Order& GetLevel() const{
+        return level;
+    }
+private:
+	ProductHandle<T> product;
+	Order level;
+};
+
+// How the market data connector publishes each book it reads
+enum BookFeedMode { SNAPSHOT, DELTA };
+
 /**
 * Pre-declearations to avoid errors.
 */
@@ -129,14 +224,14 @@ class MarketDataConnector;
 template<typename T>
 class MarketDataService : public Service<string, OrderBook<T>>{
 private:
-	map<string, OrderBook<T>> PidOrderBooksMap; //product_id -----> orderbook
+	ProductTable<T, OrderBook<T>> PidOrderBooksMap; //product index -----> orderbook
 	vector<ServiceListener<OrderBook<T>>*> listeners;
+	vector<ServiceListener<LevelUpdate<T>>*> levelListeners;
 	MarketDataConnector<T>* connector;
 	int bookDepth;
 public:
 	// Constructor and destructor
 	MarketDataService(){
-        PidOrderBooksMap = map<string, OrderBook<T>>();
         listeners = vector<ServiceListener<OrderBook<T>>*>();
         connector = new MarketDataConnector<T>(this);
         bookDepth = 5;
@@ -144,11 +239,11 @@ public:
 	~MarketDataService() = default;
 	// Get data on our service given a key
 	OrderBook<T>& GetData(string _key){
-        return PidOrderBooksMap[_key];
+        return PidOrderBooksMap.At(_key);
     }
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(OrderBook<T>& _data){
-        PidOrderBooksMap[_data.GetProduct().GetProductId()] = _data;
+        PidOrderBooksMap[_data.GetProductHandle()] = _data;
         for (auto& l : listeners){
             l->ProcessAdd(_data);
         }
@@ -169,41 +264,65 @@ public:
 	int GetBookDepth() const{
         return bookDepth;
     }
-	// Get the best bid/offer order
-	const BidOffer& GetBestBidOffer(const string& _productId){
-        return PidOrderBooksMap[_productId].GetBidOffer();
+	// Set the depth of each published book: the connector builds a book from every bookDepth * 2 lines, bookDepth a side in a well-formed file
+	void SetBookDepth(int _bookDepth){
+        bookDepth = _bookDepth;
     }
+	// Get the best bid/offer order, empty orders for a product with no book
+	BidOffer GetBestBidOffer(const string& _productId){
+        const OrderBook<T>* _orderBook = PidOrderBooksMap.Find(_productId);
+        return _orderBook ? _orderBook->GetBidOffer() : OrderBook<T>().GetBidOffer();
+    }
+	// Aggregate the depth of a product's book so each price appears once per side; throws out_of_range for a product with no book
+	const OrderBook<T>& AggregateDepth(const string& _productId){
+        OrderBook<T>& _orderBook = PidOrderBooksMap.At(_productId);
+        _orderBook.AggregateLevels();
+        return _orderBook;
+    }
+	// Add a listener for level changes: ProcessAdd for a new level, ProcessUpdate for a new quantity, ProcessRemove for a deleted level
+	void AddLevelListener(ServiceListener<LevelUpdate<T>>* _listener){
+        levelListeners.push_back(_listener);
+    }
+	// Apply one level change to a product's book and publish it to the level listeners if it changed anything
+	LevelChange UpdateLevel(ProductHandle<T> _product, PricingSide _side, double _price, long _quantity){
+        LevelChange _change = GetOrderBook(_product).UpdateLevel(_side, _price, _quantity);
+        if (_change == LEVEL_UNCHANGED) return _change;
 
-    const OrderBook<Bond>& AggregateDepth(const string& _productId) {
-        OrderBook<T>& orderBook = PidOrderBooksMap[_productId];
-
-        // Aggregate bid stack
-        vector<Order>& bidStack = orderBook.GetBidStack();
-        unordered_map<double, long> bidAggMap;
-        for (auto& order : bidStack) {
-            double price = order.GetPrice();
-            bidAggMap[price] += order.GetQuantity();
-        }
-        vector<Order> aggregatedBids;
-        for (auto& item : bidAggMap) {
-            aggregatedBids.push_back(Order(item.first, item.second, BID));
+        LevelUpdate<T> _update(_product, Order(_price, _change == LEVEL_DELETED ? 0 : _quantity, _side));
+        for (auto& l : levelListeners){
+            if (_change == LEVEL_ADDED) l->ProcessAdd(_update);
+            else if (_change == LEVEL_MODIFIED) l->ProcessUpdate(_update);
+            else l->ProcessRemove(_update);
         }
-
-        // Aggregate offer stack
-        vector<Order>& offerStack = orderBook.GetOfferStack();
-        unordered_map<double, long> offerAggMap;
-        for (auto& order : offerStack) {
-            double price = order.GetPrice();
-            offerAggMap[price] += order.GetQuantity();
+        return _change;
+    }
+	// The callback for a book snapshot in delta mode: publish only the levels that differ from the stored book to the level listeners,
+	// then the updated book to the book listeners, which still see every complete book
+	void OnSnapshotDelta(const OrderBook<T>& _snapshot){
+        ProductHandle<T> _product = _snapshot.GetProductHandle();
+        OrderBook<T>& _orderBook = GetOrderBook(_product);
+        for (PricingSide _side : { BID, OFFER }){
+            const vector<Order>& _old = (_side == BID) ? _orderBook.GetBidStack() : _orderBook.GetOfferStack();
+            const vector<Order>& _new = (_side == BID) ? _snapshot.GetBidStack() : _snapshot.GetOfferStack();
+            for (size_t i = 0; i < _old.size();){
+                if (_snapshot.GetLevelQuantity(_side, _old[i].GetPrice()) == 0) UpdateLevel(_product, _side, _old[i].GetPrice(), 0);
+                else ++i;
+            }
+            for (const Order& _level : _new){
+                UpdateLevel(_product, _side, _level.GetPrice(), _level.GetQuantity());
+            }
         }
-        vector<Order> aggregatedOffers;
-        for (auto& item : offerAggMap) {
-            aggregatedOffers.push_back(Order(item.first, item.second, OFFER));
+        for (auto& l : listeners){
+            l->ProcessAdd(_orderBook);
         }
-
-        // Update and return the aggregated order book
-        orderBook = OrderBook<T>(orderBook.GetProduct(), aggregatedBids, aggregatedOffers);
-        return orderBook;
+    }
+private:
+	// Get the stored book of a product, starting an empty one on first use
+	OrderBook<T>& GetOrderBook(ProductHandle<T> _product){
+        bool _known = PidOrderBooksMap.Contains(_product.GetIndex());
+        OrderBook<T>& _orderBook = PidOrderBooksMap[_product];
+        if (!_known) _orderBook = OrderBook<T>(_product, vector<Order>(), vector<Order>());
+        return _orderBook;
     }
 };
 /**
@@ -212,51 +331,136 @@ public:
 */
 template<typename T>
 class MarketDataConnector : public Connector<OrderBook<T>>{
+public:
+	/**
+	* One parsed line of the market data file.
+	*/
+	struct OrderLine{
+		ProductHandle<T> product;
+		double price;
+		long quantity;
+		PricingSide side;
+
+		ProductHandle<T> GetProductHandle() const{ return product; }
+	};
+
 private:
+	/**
+	* Levels read so far for the next snapshot of one product.
+	*/
+	struct PendingBook{
+		vector<Order> bidStack;
+		vector<Order> offerStack;
+	};
+
 	MarketDataService<T>* service;
+	ProductTable<T, PendingBook> pendingBooks; // product index -----> snapshot being built
+	BookFeedMode mode;
+
 public:
 	MarketDataConnector(MarketDataService<T>* _service){ // Connector and Destructor
         service = _service;
+        mode = SNAPSHOT;
     }
 	~MarketDataConnector() = default;
+	// Set whether complete books are published as snapshots or as level deltas
+	void SetMode(BookFeedMode _mode){
+        mode = _mode;
+    }
+	// Add one order line to its product's book and publish the book once it holds bookDepth * 2 lines, whatever their sides
+	void AddOrder(ProductHandle<T> _product, double _price, long _quantity, PricingSide _side){
+        PendingBook& _pending = pendingBooks[_product];
+        (_side == BID ? _pending.bidStack : _pending.offerStack).push_back(Order(_price, _quantity, _side));
+        if (_pending.bidStack.size() + _pending.offerStack.size() < size_t(service->GetBookDepth() * 2)) return;
+
+        OrderBook<T> _orderBook(_product, _pending.bidStack, _pending.offerStack);
+        _pending.bidStack.clear();
+        _pending.offerStack.clear();
+        if (mode == DELTA){
+            _orderBook.AggregateLevels();
+            service->OnSnapshotDelta(_orderBook);
+        }
+        else{
+            service->OnMessage(_orderBook);
+        }
+    }
 	void Publish(OrderBook<T>& _data){ // Publish data to the Connector
         service->OnMessage(_data);
     }
+    // Subscribe data from the Connector, parsing each line with ParseLine() as the parallel loaders do
     void Subscribe(std::ifstream& dataStream) {
-        const int bookDepth = service->GetBookDepth();
-        const int threadCount = bookDepth * 2;
-        long count = 0;
-        std::vector<Order> bidStack, offerStack;
         std::string line;
+        std::vector<OrderLine> orders;
         while (std::getline(dataStream, line)) {
-            std::stringstream lineStream(line);
-            std::string productId, cell;
-            double price;
-            long quantity;
-            PricingSide side;
-
-            std::getline(lineStream, productId, ',');
-            std::getline(lineStream, cell, ',');
-            price = ConvertPrice(cell);
-            std::getline(lineStream, cell, ',');
-            quantity = std::stol(cell);
-            std::getline(lineStream, cell, ',');
-            side = (cell == "BID") ? BID : OFFER;
-            Order order(price, quantity, side);
-            (side == BID ? bidStack : offerStack).push_back(order);
+            if (line.empty()) continue;
+            orders.clear();
+            ParseLine(line, orders);
+            for (auto& o : orders) AddOrder(o.product, o.price, o.quantity, o.side);
+        }
+    }
+    // Subscribe data from a memory-mapped file, parsing every line in place straight into its product's book;
+    // throws runtime_error if the file cannot be opened or mapped
+    void SubscribeMapped(const string& _path) {
+        auto _start = steady_clock::now();
+        MappedFile _file(_path);
+        string_view _text = _file.View();
+        long _lines = 0;
+        while (!_text.empty()) {
+            string_view _line = NextToken(_text, '\n');
+            if (_line.empty()) continue;
 
-//            // output the size of bidStack and offerStack
-//            cout << "bidStack size: " << bidStack.size() << endl;
-//            cout << "offerStack size: " << offerStack.size() << endl;
-            count++;
-            if (count % threadCount == 0) {
-                T product = GetBond(productId);
-                OrderBook<T> orderBook(product, bidStack, offerStack);
-                service->OnMessage(orderBook);
-            }
+            OrderLine _order = ParseOrder(_line);
+            AddOrder(_order.product, _order.price, _order.quantity, _order.side);
+            _lines++;
         }
+
+        // report the ingestion throughput
+        double _seconds = duration<double>(steady_clock::now() - _start).count();
+        double _megabytes = _file.Size() / (1024.0 * 1024.0);
+        Logger::Instance().Log(LogLevel::INFO, "Market data mapped ingestion: {} lines, {} MB in {} s ({} lines/sec, {} MB/sec)",
+                               _lines, _megabytes, _seconds, _lines / _seconds, _megabytes / _seconds);
+    }
+    // Subscribe data from a file parsed on _threads threads (one per core if 0), building books from the lines in file order
+    void SubscribeParallel(const string& _path, size_t _threads = 0) {
+        ParallelLoader<OrderLine>(_threads).Load(_path, &MarketDataConnector::ParseLine, [&](OrderLine& _order) {
+            AddOrder(_order.product, _order.price, _order.quantity, _order.side);
+        });
+    }
+    // Parse a "product,price,quantity,side" line in place
+    static void ParseLine(string_view _line, vector<OrderLine>& _orders) {
+        _orders.push_back(ParseOrder(_line));
+    }
+    // Parse a "product,price,quantity,side" line in place into one order line
+    static OrderLine ParseOrder(string_view _line) {
+        ProductHandle<T> _product = GetProductHandle<T>(NextToken(_line, ','));
+        double _price = ConvertPrice(NextToken(_line, ','));
+        long _quantity = ParseLong(NextToken(_line, ','));
+        PricingSide _side = ParsePricingSide(NextToken(_line, ','));
+        return OrderLine{ _product, _price, _quantity, _side };
     }
 };
 
+/**
+* Level listener counting the changes the market data service publishes in DELTA mode.
+* Type T is the product type.
+*/
+template<typename T>
+class LevelChangeCounter final : public ServiceListener<LevelUpdate<T>>{
+public:
+	// Listener callback for a new level
+	void ProcessAdd(LevelUpdate<T>& _data) override{ added++; }
+	// Listener callback for a deleted level
+	void ProcessRemove(LevelUpdate<T>& _data) override{ removed++; }
+	// Listener callback for a level with a new quantity
+	void ProcessUpdate(LevelUpdate<T>& _data) override{ modified++; }
+
+	long GetAdded() const{ return added; }
+	long GetModified() const{ return modified; }
+	long GetRemoved() const{ return removed; }
+private:
+	long added = 0;
+	long modified = 0;
+	long removed = 0;
+};
 
 #endif
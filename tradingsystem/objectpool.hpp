@@ -0,0 +1,114 @@
+/**
+* objectpool.hpp
+* Defines a per-type object pool and a move-only owning pointer that returns its object to the pool.
+*
+*/
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+template<typename E>
+class ObjectPool;
+
+/**
+* Deleter handing an object back to the pool it came from.
+* Type E is the pooled type.
+*/
+template<typename E>
+struct PoolDeleter{
+	ObjectPool<E>* pool = nullptr;
+	void operator()(E* _object) const{
+        pool->Release(_object);
+    }
+};
+
+// Move-only owner of a pooled object
+template<typename E>
+using PooledPtr = unique_ptr<E, PoolDeleter<E>>;
+
+/**
+* Pool of objects of type E carved out of fixed-size chunks.
+* Released objects are destroyed in place and their slots reused by the next Acquire(), so a
+* steady stream of short-lived events settles on a fixed number of slots instead of growing the heap.
+* Every object must be released before the pool is destroyed. Not synchronized: acquire and release
+* on the thread that owns the pool.
+* Type E is the pooled type.
+*/
+template<typename E>
+class ObjectPool{
+public:
+	// ctor for a pool growing _chunkSize objects at a time
+	explicit ObjectPool(size_t _chunkSize = 64) : chunkSize(_chunkSize), freeList(nullptr), capacity(0), inUse(0){}
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+	// Construct an object in a free slot
+	template<typename... Args>
+	E* Acquire(Args&&... _args){
+        if (!freeList) Grow();
+        Slot* _slot = freeList;
+        freeList = _slot->next;
+        E* _object;
+        try{
+            _object = new (_slot->storage) E(forward<Args>(_args)...);
+        }
+        catch (...){
+            _slot->next = freeList;
+            freeList = _slot;
+            throw;
+        }
+        inUse++;
+        return _object;
+    }
+	// Construct an object in a free slot, owned by a pointer that releases it
+	template<typename... Args>
+	PooledPtr<E> Make(Args&&... _args){
+        return PooledPtr<E>(Acquire(forward<Args>(_args)...), PoolDeleter<E>{this});
+    }
+	// Destroy an object and make its slot free
+	void Release(E* _object){
+        _object->~E();
+        Slot* _slot = reinterpret_cast<Slot*>(_object);
+        _slot->next = freeList;
+        freeList = _slot;
+        inUse--;
+    }
+	// Get the number of slots allocated
+	size_t Capacity() const{
+        return capacity;
+    }
+	// Get the number of objects currently acquired
+	size_t InUse() const{
+        return inUse;
+    }
+private:
+	union Slot{
+		Slot* next;
+		alignas(E) unsigned char storage[sizeof(E)];
+	};
+
+	// Allocate a chunk and thread its slots onto the free list
+	void Grow(){
+        chunks.emplace_back(new Slot[chunkSize]);
+        Slot* _chunk = chunks.back().get();
+        for (size_t i = 0; i < chunkSize; ++i){
+            _chunk[i].next = freeList;
+            freeList = &_chunk[i];
+        }
+        capacity += chunkSize;
+    }
+
+	size_t chunkSize;
+	vector<unique_ptr<Slot[]>> chunks;
+	Slot* freeList;
+	size_t capacity;
+	size_t inUse;
+};
+
+#endif
@@ -0,0 +1,156 @@
+/**
+* parallelloader.hpp
+* Defines a loader that parses a large input file on several threads and delivers the parsed
+* records in file order.
+*
+*/
+#ifndef PARALLEL_LOADER_HPP
+#define PARALLEL_LOADER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <cstring>
+#include "mappedfile.hpp"
+
+using namespace std;
+
+// Bytes of input parsed as one chunk
+const size_t LOADER_CHUNK_SIZE = 1 << 22;
+
+// Chunks each thread may parse ahead of delivery, which bounds the records held in memory
+const size_t LOADER_CHUNKS_AHEAD = 4;
+
+/**
+* Parses a memory-mapped file on a pool of threads and hands the records to the calling thread in file order.
+* The file is cut into chunks of about chunkSize bytes at line boundaries. Workers claim chunks in turn and
+* parse each into its own batch of records, while the calling thread delivers the batches one chunk after
+* another as they complete, so the downstream service sees exactly the sequence a single-threaded loop would
+* produce. Workers run at most LOADER_CHUNKS_AHEAD chunks per thread ahead of delivery, so memory use is set
+* by that window rather than by the size of the file. An exception thrown while parsing is rethrown by Load().
+* Type R is the parsed record type.
+*/
+template<typename R>
+class ParallelLoader{
+public:
+	// ctor for a loader parsing on _threads threads, one per core if 0
+	explicit ParallelLoader(size_t _threads = 0, size_t _chunkSize = LOADER_CHUNK_SIZE)
+        : threads(_threads > 0 ? _threads : max<size_t>(thread::hardware_concurrency(), 1)), chunkSize(max<size_t>(_chunkSize, 1)){}
+
+	// Parse every non-empty line of _path with _parse(string_view, vector<R>&), which appends the line's record if it has one,
+	// and hand each record to _deliver(R&) on the calling thread in file order; returns the number of records delivered
+	template<typename Parse, typename Deliver>
+	long Load(const string& _path, Parse _parse, Deliver _deliver){
+        MappedFile _file(_path);
+        vector<string_view> _chunks = Split(_file.View());
+        size_t _window = min(threads * LOADER_CHUNKS_AHEAD, max<size_t>(_chunks.size(), 1));
+        vector<Batch> _batches(_window);
+        atomic<size_t> _next(0);
+        size_t _delivered = 0;
+        bool _failed = false;
+        exception_ptr _error;
+        mutex _guard;
+        condition_variable _parsed, _freed;
+
+        auto _work = [&]() {
+            while (true){
+                size_t _chunk = _next.fetch_add(1);
+                if (_chunk >= _chunks.size()) return;
+                Batch& _batch = _batches[_chunk % _window];
+                {
+                    unique_lock<mutex> _lock(_guard);
+                    _freed.wait(_lock, [&]() { return _failed || _chunk < _delivered + _window; });
+                    if (_failed) return;
+                }
+                try{
+                    _batch.records.clear();
+                    string_view _text = _chunks[_chunk];
+                    while (!_text.empty()){
+                        string_view _line = NextToken(_text, '\n');
+                        if (!_line.empty()) _parse(_line, _batch.records);
+                    }
+                }
+                catch (...){
+                    lock_guard<mutex> _lock(_guard);
+                    if (!_error) _error = current_exception();
+                    _failed = true;
+                    _parsed.notify_all();
+                    _freed.notify_all();
+                    return;
+                }
+                lock_guard<mutex> _lock(_guard);
+                _batch.ready = true;
+                _parsed.notify_all();
+            }
+        };
+        vector<thread> _workers;
+        for (size_t i = 0; i < min(threads, _chunks.size()); ++i) _workers.emplace_back(_work);
+
+        long _records = 0;
+        try{
+            for (size_t c = 0; c < _chunks.size(); ++c){
+                Batch& _batch = _batches[c % _window];
+                {
+                    unique_lock<mutex> _lock(_guard);
+                    _parsed.wait(_lock, [&]() { return _failed || _batch.ready; });
+                    if (_failed) break;
+                }
+                for (auto& r : _batch.records) _deliver(r);
+                _records += _batch.records.size();
+                lock_guard<mutex> _lock(_guard);
+                _batch.ready = false;
+                _delivered = c + 1;
+                _freed.notify_all();
+            }
+        }
+        catch (...){
+            lock_guard<mutex> _lock(_guard);
+            if (!_error) _error = current_exception();
+            _failed = true;
+            _freed.notify_all();
+        }
+        for (auto& w : _workers) w.join();
+        if (_error) rethrow_exception(_error);
+        return _records;
+    }
+
+	// Get the number of parsing threads
+	size_t GetThreads() const{
+        return threads;
+    }
+
+private:
+	/**
+	* Records parsed from one chunk, waiting for delivery.
+	*/
+	struct Batch{
+		vector<R> records;
+		bool ready = false;
+	};
+
+	// Cut _text into chunks of about chunkSize bytes, each ending after a newline or at the end of the file
+	vector<string_view> Split(string_view _text) const{
+        vector<string_view> _chunks;
+        while (!_text.empty()){
+            size_t _size = min(chunkSize, _text.size());
+            if (_size < _text.size()){
+                const char* _newline = static_cast<const char*>(memchr(_text.data() + _size, '\n', _text.size() - _size));
+                _size = _newline ? _newline - _text.data() + 1 : _text.size();
+            }
+            _chunks.push_back(_text.substr(0, _size));
+            _text.remove_prefix(_size);
+        }
+        return _chunks;
+    }
+
+	size_t threads;
+	size_t chunkSize;
+};
+
+#endif
@@ -12,63 +12,72 @@
 #define POSITION_SERVICE_HPP
 
 #include <string>
-#include <map>
 #include "soa.hpp"
+#include "positionstore.hpp"
 #include "tradebookingservice.hpp"
 
 using namespace std;
 
 /**
 * Position class in a particular book.
+* A position is a view of one product's row in a PositionStore: copying it is cheap and it always
+* reads the store's current positions. Edges and queues that hand events to another thread refuse it (IsStoreView).
 * Type T is the product type.
 */
 template<typename T>
 class Position{
 public:
+	// the store a position reads, which makes it a view (see IsStoreView)
+	typedef PositionStore<T> ViewOf;
 
 	// ctor for a position
-	Position() = default;
-	Position(const T& _product){
+	Position() : store(nullptr){}
+	Position(ProductHandle<T> _product, PositionStore<T>& _store){
         product = _product;
-        positions_all_book = map<string, long>();
+        store = &_store;
     }
 	const T& GetProduct() const{
+        return product.Get();
+    }
+	// Get the handle onto the registered product
+	ProductHandle<T> GetProductHandle() const{
         return product;
     }
-	long GetPosition(string& _book){
-        return positions_all_book[_book];
+	long GetPosition(const string& _book) const{
+        size_t _bookId = store ? store->GetBooks().Find(_book) : BookRegistry::NOT_FOUND;
+        return _bookId != BookRegistry::NOT_FOUND ? store->Get(product.GetIndex(), _bookId) : 0;
     }
-	map<string, long> GetPositions(){
-        return positions_all_book;
+	// Call _func(book, position) for each book the product has been booked in, in book order
+	template<typename F>
+	void ForEachBook(F _func) const{
+        if (store) store->ForEachBook(product.GetIndex(), _func);
     }
 	void AddPosition(const string& _book, long _position){
-        positions_all_book[_book] += _position;
+        store->Add(product.GetIndex(), store->GetBooks().Intern(_book), _position);
     }
-	long GetAggregatePosition(){
-        long aggregatePosition = 0;
-        for (auto& p : positions_all_book){
-            aggregatePosition += p.second;
-        }
-        return aggregatePosition;
+	long GetAggregatePosition() const{
+        return store ? store->GetAggregate(product.GetIndex()) : 0;
     }
 	vector<string> ToStrings() const{
-        string _product = product.GetProductId();
-        vector<string> _positions;
-        for (auto& p : positions_all_book){
-            string _book = p.first;
-            string _position = to_string(p.second);
-            _positions.push_back(_book);
-            _positions.push_back(_position);
-        }
-
         vector<string> _strings;
-        _strings.push_back(_product);
-        _strings.insert(_strings.end(), _positions.begin(), _positions.end());
+        _strings.push_back(product.Get().GetProductId());
+        ForEachBook([&](const string& _book, long _position) {
+            _strings.push_back(_book);
+            _strings.push_back(to_string(_position));
+        });
         return _strings;
     }
+	// Write the fields ToStrings() returns into _buffer
+	void WriteTo(RecordBuffer& _buffer) const{
+        _buffer.WriteField(product.Get().GetProductId());
+        ForEachBook([&](const string& _book, long _position) {
+            _buffer.WriteField(_book);
+            _buffer.WriteInteger(_position);
+        });
+    }
 private:
-	T product;
-	map<string, long> positions_all_book;  //book_id, position
+	ProductHandle<T> product;
+	PositionStore<T>* store;
 };
 
 
@@ -86,7 +95,8 @@ class PositionListenerFromTradeBooking;
 template<typename T>
 class PositionService: public Service<string, Position<T>>{
 private:
-	map<string, Position<T>> PidPositionMap; // product_id, position
+	PositionStore<T> store;                      // product x book positions
+	ProductTable<T, Position<T>> PidPositionMap; // product index, position
 	vector<ServiceListener<Position<T>>*> listeners;
 	PositionListenerFromTradeBooking<T>* listener;
 public:
@@ -98,11 +108,11 @@ public:
 
 	// Get data on our service given a key
 	Position<T>& GetData(string _key){
-        return PidPositionMap[_key];
+        return PidPositionMap.At(_key);
     }
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(Position<T>& _data){
-        PidPositionMap[_data.GetProduct().GetProductId()] = _data;
+        PidPositionMap[_data.GetProductHandle()] = _data;
         for (auto& _listener : listeners){
             _listener->ProcessAdd(_data);
         }
@@ -119,24 +129,25 @@ public:
 	// Get the listener of the service
 	PositionListenerFromTradeBooking<T>* GetListener(){
         return listener;
+    }
+	// Get the store holding every position
+	const PositionStore<T>& GetStore() const{
+        return store;
     }
 	// Add a trade to the service
     void AddTrade(const Trade<T>& _trade) {
-        const T& _product = _trade.GetProduct();
-        const string& _productId = _product.GetProductId();
+        ProductHandle<T> _product = _trade.GetProductHandle();
         long _tradeQuantity = (_trade.GetSide() == BUY) ? _trade.GetQuantity() : -_trade.GetQuantity();
 
         // Check if the position exists, create if not
-        auto it = PidPositionMap.find(_productId);
-        if (it == PidPositionMap.end()) {
+        if (!PidPositionMap.Contains(_product.GetIndex())) {
             // Handling for new product
-            Position<T> newPosition(_product);
-            it = PidPositionMap.insert(std::make_pair(_productId, newPosition)).first;
+            PidPositionMap[_product] = Position<T>(_product, store);
         }
 
         // Update the position for the specific product
-        Position<T>& _position = it->second;
-        _position.AddPosition(_trade.GetBook(), _tradeQuantity);
+        Position<T>& _position = PidPositionMap[_product];
+        store.Add(_product.GetIndex(), store.GetBooks().Intern(_trade.GetBook()), _tradeQuantity);
 
         // On_message
         OnMessage(_position);
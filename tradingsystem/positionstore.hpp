@@ -0,0 +1,157 @@
+/**
+* positionstore.hpp
+* Defines interned trading book identifiers and a flat store of positions per product and book.
+* Positions are held in one contiguous product x book matrix of longs, with the aggregate
+* across books maintained per product, so booking a trade and reading an aggregate are O(1).
+*
+*/
+#ifndef POSITION_STORE_HPP
+#define POSITION_STORE_HPP
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "productregistry.hpp"
+
+using namespace std;
+
+/**
+* Registry interning trading book identifiers as small consecutive indices.
+* Books are never removed, so names and indices stay valid for the registry's lifetime.
+* Each PositionStore owns one, so the registry is only touched by the thread that owns the positions.
+*/
+class BookRegistry{
+public:
+	static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+	BookRegistry() = default;
+	// not copyable, since the index holds views into the interned names
+	BookRegistry(const BookRegistry&) = delete;
+	BookRegistry& operator=(const BookRegistry&) = delete;
+
+	// Intern a book if it is not known yet and return its index
+	size_t Intern(string_view _book){
+        size_t _index = Find(_book);
+        if (_index != NOT_FOUND) return _index;
+
+        names.push_back(string(_book));
+        _index = names.size() - 1;
+        indices[string_view(names.back())] = _index;
+        sortedIds.insert(upper_bound(sortedIds.begin(), sortedIds.end(), _index,
+            [&](size_t a, size_t b) { return names[a] < names[b]; }), _index);
+        return _index;
+    }
+	// Find the index of a book, NOT_FOUND if it has not been interned
+	size_t Find(string_view _book) const{
+        auto it = indices.find(_book);
+        return it == indices.end() ? NOT_FOUND : it->second;
+    }
+	// Get the name of a book
+	const string& GetName(size_t _index) const{
+        return names[_index];
+    }
+	// Get the book indices in name order
+	const vector<size_t>& GetSortedIds() const{
+        return sortedIds;
+    }
+	// Get the number of interned books
+	size_t Size() const{
+        return names.size();
+    }
+private:
+	deque<string> names;
+	unordered_map<string_view, size_t> indices; // views into the interned names
+	vector<size_t> sortedIds;
+};
+
+/**
+* Positions of every product in every book.
+* Row p of the matrix holds product p's position in each book, so one product's books are contiguous;
+* the row stride doubles when a new book no longer fits. A product's aggregate is kept up to date on each Add().
+* Book indices come from the store's own BookRegistry, so stores on different threads share no state.
+* Type T is the product type.
+*/
+template<typename T>
+class PositionStore{
+public:
+	// ctor sized for every product registered so far
+	PositionStore() : products(0), stride(8){
+        Reserve(ProductRegistry<T>::Instance().Size(), 0);
+    }
+	// Get the registry of the books this store holds positions in
+	BookRegistry& GetBooks(){
+        return books;
+    }
+	const BookRegistry& GetBooks() const{
+        return books;
+    }
+	// Add _quantity to a product's position in a book
+	void Add(size_t _product, size_t _book, long _quantity){
+        Reserve(_product + 1, _book + 1);
+        size_t _cell = _product * stride + _book;
+        quantities[_cell] += _quantity;
+        booked[_cell] = true;
+        aggregates[_product] += _quantity;
+    }
+	// Get a product's position in a book
+	long Get(size_t _product, size_t _book) const{
+        return (_product < products && _book < stride) ? quantities[_product * stride + _book] : 0;
+    }
+	// Whether a product has ever been booked in a book
+	bool IsBooked(size_t _product, size_t _book) const{
+        return _product < products && _book < stride && booked[_product * stride + _book];
+    }
+	// Get a product's position summed over every book
+	long GetAggregate(size_t _product) const{
+        return _product < products ? aggregates[_product] : 0;
+    }
+	// Remove every position of a product
+	void Clear(size_t _product){
+        if (_product >= products) return;
+        fill(quantities.begin() + _product * stride, quantities.begin() + (_product + 1) * stride, 0);
+        fill(booked.begin() + _product * stride, booked.begin() + (_product + 1) * stride, false);
+        aggregates[_product] = 0;
+    }
+	// Call _func(book name, position) for each book a product has been booked in, in book name order
+	template<typename F>
+	void ForEachBook(size_t _product, F _func) const{
+        for (size_t _book : books.GetSortedIds()){
+            if (IsBooked(_product, _book)) _func(books.GetName(_book), Get(_product, _book));
+        }
+    }
+private:
+	// Grow the matrix to hold at least _products rows and _books columns
+	void Reserve(size_t _products, size_t _books){
+        if (_books > stride){
+            size_t _stride = stride;
+            while (_stride < _books) _stride *= 2;
+            vector<long> _quantities(products * _stride, 0);
+            vector<char> _booked(products * _stride, false);
+            for (size_t p = 0; p < products; ++p){
+                copy(quantities.begin() + p * stride, quantities.begin() + (p + 1) * stride, _quantities.begin() + p * _stride);
+                copy(booked.begin() + p * stride, booked.begin() + (p + 1) * stride, _booked.begin() + p * _stride);
+            }
+            quantities.swap(_quantities);
+            booked.swap(_booked);
+            stride = _stride;
+        }
+        if (_products > products){
+            products = _products;
+            quantities.resize(products * stride, 0);
+            booked.resize(products * stride, false);
+            aggregates.resize(products, 0);
+        }
+    }
+
+	BookRegistry books;       // book name <-> column
+	size_t products;          // rows
+	size_t stride;            // columns per row
+	vector<long> quantities;  // product x book positions
+	vector<char> booked;      // product x book, whether the product was ever booked in the book
+	vector<long> aggregates;  // position over all books per product
+};
+
+#endif
@@ -0,0 +1,121 @@
+/**
+* pricecodec.hpp
+* Defines an allocation-free codec for US Treasury fractional prices.
+* Prices are held as an integer count of 1/256ths of a point, so "99-16+" is 99 * 256 + 16 * 8 + 4.
+*
+*/
+#ifndef PRICE_CODEC_HPP
+#define PRICE_CODEC_HPP
+
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <cmath>
+
+using namespace std;
+
+// Number of price ticks in one point
+const long TICKS_PER_POINT = 256;
+
+// Buffer size large enough for any formatted price
+const size_t PRICE_BUFFER_SIZE = 24;
+
+// Whether _c is a decimal digit.
+bool IsDigit(char _c)
+{
+	return _c >= '0' && _c <= '9';
+}
+
+// Parse a fractional price (e.g. 99-16+) in [_first, _last) into 1/256ths.
+long ParsePriceTicks(const char* _first, const char* _last)
+{
+	bool _negative = (_first != _last && *_first == '-');
+	if (_negative) ++_first;
+
+	long _points = 0;
+	const char* _p = _first;
+	while (_p != _last && IsDigit(*_p))
+	{
+		_points = _points * 10 + (*_p - '0');
+		++_p;
+	}
+	if (_p == _first || _last - _p != 4 || *_p != '-' || !IsDigit(_p[1]) || !IsDigit(_p[2])) throw invalid_argument("Invalid price");
+
+	// xy is the number of 32nds, z the number of 256ths with '+' being 4
+	int _xy = (_p[1] - '0') * 10 + (_p[2] - '0');
+	char _zChar = _p[3];
+	int _z = (_zChar == '+') ? 4 : _zChar - '0';
+	if (_xy > 31 || (_zChar != '+' && !IsDigit(_zChar)) || _z > 7) throw invalid_argument("Invalid price");
+
+	long _ticks = _points * TICKS_PER_POINT + _xy * 8 + _z;
+	return _negative ? -_ticks : _ticks;
+}
+
+// Parse a fractional price held in a view into 1/256ths.
+long ParsePriceTicks(string_view _price)
+{
+	return ParsePriceTicks(_price.data(), _price.data() + _price.size());
+}
+
+// Format 1/256ths as a fractional price into _buffer (at least PRICE_BUFFER_SIZE chars), returning the length written.
+size_t FormatPriceTicks(long _ticks, char* _buffer)
+{
+	char* _p = _buffer;
+	if (_ticks < 0)
+	{
+		*_p++ = '-';
+		_ticks = -_ticks;
+	}
+
+	long _points = _ticks / TICKS_PER_POINT;
+	int _fraction = _ticks % TICKS_PER_POINT;
+
+	// write the integral digits backwards then reverse them in place
+	char* _digits = _p;
+	do
+	{
+		*_p++ = static_cast<char>('0' + _points % 10);
+		_points /= 10;
+	} while (_points > 0);
+	for (char *_l = _digits, *_r = _p - 1; _l < _r; ++_l, --_r)
+	{
+		char _c = *_l;
+		*_l = *_r;
+		*_r = _c;
+	}
+
+	int _xy = _fraction / 8;
+	int _z = _fraction % 8;
+	*_p++ = '-';
+	*_p++ = static_cast<char>('0' + _xy / 10);
+	*_p++ = static_cast<char>('0' + _xy % 10);
+	*_p++ = (_z == 4) ? '+' : static_cast<char>('0' + _z);
+	return _p - _buffer;
+}
+
+// Convert 1/256ths to a numerical price.
+double TicksToPrice(long _ticks)
+{
+	return _ticks / static_cast<double>(TICKS_PER_POINT);
+}
+
+// Convert a numerical price to 1/256ths, truncating anything finer than a tick.
+long PriceToTicks(double _price)
+{
+	return static_cast<long>(floor(_price * TICKS_PER_POINT));
+}
+
+// Convert fractional price (e.g. 99-16+) to numerical price.
+double ConvertPrice(string_view _price)
+{
+	return TicksToPrice(ParsePriceTicks(_price));
+}
+
+// Convert numerical price to fractional price.
+string ConvertPrice(double _price)
+{
+	char _buffer[PRICE_BUFFER_SIZE];
+	return string(_buffer, FormatPriceTicks(PriceToTicks(_price), _buffer));
+}
+
+#endif
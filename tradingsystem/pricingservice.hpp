@@ -10,6 +10,7 @@
 #include "soa.hpp"
 #include "products.hpp"
 #include "functions.hpp"
+#include "parallelloader.hpp"
 
 /**
 * A price object consisting of mid and bid/offer spread.
@@ -22,15 +23,16 @@ class Price{
 public:
 	
 	Price() = default; // ctor for a price
-	Price(const T& _product, double _mid, double _bidOfferSpread): product(_product){
+	Price(ProductHandle<T> _product, double _mid, double _bidOfferSpread): product(_product){
         mid = _mid;
         bidOfferSpread = _bidOfferSpread;
     }
-	const T& GetProduct() const{ return product;} // Get the product
+	const T& GetProduct() const{ return product.Get();} // Get the product
+	ProductHandle<T> GetProductHandle() const{ return product;} // Get the handle onto the registered product
 	double GetMid() const { return mid; }  // Get the midprice
 	double GetBidOfferSpread() const { return bidOfferSpread; } // Get the bid/offer spread around the mid
 	vector<string> ToStrings() const{
-        string _product = product.GetProductId();
+        string _product = product.Get().GetProductId();
         string _mid = ConvertPrice(mid);
         string _bidOfferSpread = ConvertPrice(bidOfferSpread);
         vector<string> _strings;
@@ -39,10 +41,16 @@ public:
         _strings.push_back(_bidOfferSpread);
         return _strings;
     }
+	// Write the fields ToStrings() returns into _buffer
+	void WriteTo(RecordBuffer& _buffer) const{
+        _buffer.WriteField(product.Get().GetProductId());
+        _buffer.WritePrice(mid);
+        _buffer.WritePrice(bidOfferSpread);
+    }
 
 private:
 
-	T product;
+	ProductHandle<T> product;
 	double mid;
 	double bidOfferSpread;
 
@@ -60,7 +68,7 @@ class PricingConnector;
 template<typename T>
 class PricingService : public Service<string, Price<T>>{
 private:
-	map<string, Price<T>> PrdPricesMap;
+	ProductTable<T, Price<T>> PrdPricesMap;
 	vector<ServiceListener<Price<T>>*> listeners;
 	PricingConnector<T>* connector;
 
@@ -72,12 +80,15 @@ public:
 	~PricingService() = default;
     
 	Price<T>& GetData(string _productId) override{
-        return PrdPricesMap[_productId];}
+        return PrdPricesMap.At(_productId);}
     void OnMessage(Price<T>& _data) override {    	// The callback that a Connector should invoke for any new or updated data
-        PrdPricesMap[_data.GetProduct().GetProductId()] = _data;
-        for (auto& listener : listeners) {
-            listener->ProcessAdd(_data);  
-        }
+        VirtualListeners<Price<T>> _sink(listeners);
+        OnMessage(_data, _sink);
+    }
+	template<typename Sink>
+	void OnMessage(Price<T>& _data, Sink& _sink){    // Same callback, publishing to a compile-time sink (see ListenerList)
+        PrdPricesMap[_data.GetProductHandle()] = _data;
+        _sink.ProcessAdd(_data);
     }
 	void AddListener(ServiceListener<Price<T>>* _listener) override{
         listeners.push_back(_listener);}  // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -108,27 +119,28 @@ public:
 	// Publish data to the Connector
 	void Publish(Price<T>& _data){}
 
-	// Subscribe data from the Connector
+	// Subscribe data from the Connector, parsing each line with ParseLine() as the parallel loaders do
 	void Subscribe(ifstream& _data){
         string _line;
+        vector<Price<T>> _prices;
         while (getline(_data, _line)){
-            stringstream _lineStream(_line);
-            string _cell;
-            vector<string> _cells;
-            while (getline(_lineStream, _cell, ',')){
-                _cells.push_back(_cell);
-            }
-
-            string _productId = _cells[0];
-            double _bidPrice = ConvertPrice(_cells[1]);
-            double _offerPrice = ConvertPrice(_cells[2]);
-            double _midPrice = (_bidPrice + _offerPrice) / 2.0;
-            double _spread = _offerPrice - _bidPrice;
-            T _product = GetBond(_productId);
-            Price<T> _price(_product, _midPrice, _spread);
-            service->OnMessage(_price);
+            if (_line.empty()) continue;
+            _prices.clear();
+            ParseLine(_line, _prices);
+            for (auto& p : _prices) service->OnMessage(p);
         }
     }
+	// Subscribe data from a file parsed on _threads threads (one per core if 0), delivering prices in file order
+	void SubscribeParallel(const string& _path, size_t _threads = 0){
+        ParallelLoader<Price<T>>(_threads).Load(_path, &PricingConnector::ParseLine, [&](Price<T>& _price) { service->OnMessage(_price); });
+    }
+	// Parse a "product,bid,offer" line in place
+	static void ParseLine(string_view _line, vector<Price<T>>& _prices){
+        ProductHandle<T> _product = GetProductHandle<T>(NextToken(_line, ','));
+        double _bidPrice = ConvertPrice(NextToken(_line, ','));
+        double _offerPrice = ConvertPrice(NextToken(_line, ','));
+        _prices.push_back(Price<T>(_product, (_bidPrice + _offerPrice) / 2.0, _offerPrice - _bidPrice));
+    }
 
 };
 
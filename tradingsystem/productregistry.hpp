@@ -0,0 +1,116 @@
+/**
+* productregistry.hpp
+* Defines an interned registry of products and a lightweight handle onto a registered product.
+* Every product is stored once and handed out as a stable reference or a small integer index,
+* so messages never copy a product (and its strings) on the hot path.
+*
+*/
+#ifndef PRODUCT_REGISTRY_HPP
+#define PRODUCT_REGISTRY_HPP
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+* Registry interning products of type T, keyed on product identifier.
+* Products are never removed or moved, so references and indices stay valid for the whole run.
+* Register the universe up front: lookups are read-only and safe to share across threads,
+* registration is not.
+* Type T is the product type.
+*/
+template<typename T>
+class ProductRegistry{
+public:
+	static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+	// Get the registry for product type T
+	static ProductRegistry<T>& Instance(){
+        static ProductRegistry<T> _registry;
+        return _registry;
+    }
+	// Register a product if it is not known yet and return its index
+	size_t Register(const T& _product){
+        size_t _index = Find(_product.GetProductId());
+        if (_index != NOT_FOUND) return _index;
+
+        products.push_back(_product);
+        _index = products.size() - 1;
+        indices[string_view(products.back().GetProductId())] = _index;
+        return _index;
+    }
+	// Find the index of a product from its identifier bytes, NOT_FOUND if it is not registered
+	size_t Find(string_view _productId) const{
+        auto it = indices.find(_productId);
+        return it == indices.end() ? NOT_FOUND : it->second;
+    }
+	// Get a product by index
+	const T& Get(size_t _index) const{
+        return products[_index];
+    }
+	// Get a product by identifier
+	const T& Get(string_view _productId) const{
+        size_t _index = Find(_productId);
+        if (_index == NOT_FOUND) throw invalid_argument("Unknown product " + string(_productId));
+        return products[_index];
+    }
+	// Get the number of registered products
+	size_t Size() const{
+        return products.size();
+    }
+private:
+	ProductRegistry() = default;
+	deque<T> products;
+	unordered_map<string_view, size_t> indices; // views into the registered product ids
+};
+
+/**
+* A handle onto a registered product: a pointer and an index, cheap to copy.
+* A default handle refers to a default-constructed product that is not registered.
+* Type T is the product type.
+*/
+template<typename T>
+class ProductHandle{
+public:
+	// ctor for an empty handle
+	ProductHandle() : product(&Empty()), index(ProductRegistry<T>::NOT_FOUND){}
+	// ctor from a registered product, looked up by its identifier; throws if it is not registered
+	explicit ProductHandle(const T& _product){
+        ProductRegistry<T>& _registry = ProductRegistry<T>::Instance();
+        index = _registry.Find(_product.GetProductId());
+        if (index == ProductRegistry<T>::NOT_FOUND) throw invalid_argument("Unknown product " + _product.GetProductId());
+        product = &_registry.Get(index);
+    }
+	// ctor from a registered product index
+	explicit ProductHandle(size_t _index) : product(&ProductRegistry<T>::Instance().Get(_index)), index(_index){}
+
+	// Get the product
+	const T& Get() const{ return *product; }
+	// Get the product index in the registry
+	size_t GetIndex() const{ return index; }
+
+	bool operator==(const ProductHandle<T>& _other) const{ return product == _other.product; }
+	bool operator!=(const ProductHandle<T>& _other) const{ return product != _other.product; }
+private:
+	static const T& Empty(){
+        static const T _empty{};
+        return _empty;
+    }
+	const T* product;
+	size_t index;
+};
+
+// Get a handle onto a registered product from its identifier bytes.
+template<typename T>
+ProductHandle<T> GetProductHandle(string_view _productId)
+{
+	size_t _index = ProductRegistry<T>::Instance().Find(_productId);
+	if (_index == ProductRegistry<T>::NOT_FOUND) throw invalid_argument("Unknown product " + string(_productId));
+	return ProductHandle<T>(_index);
+}
+
+#endif
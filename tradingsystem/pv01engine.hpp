@@ -0,0 +1,283 @@
+/**
+* pv01engine.hpp
+* Defines a closed-form PV01 engine for fixed-coupon bonds.
+* PV01 is the fall in price per 100 face for a one basis point rise in yield, taken from the
+* analytic derivative of the annuity price formula, and cached per bond until its yield moves.
+* Whole-universe revaluation runs as one batch over structure-of-arrays inputs, four bonds at a time with AVX2.
+*
+*/
+#ifndef PV01_ENGINE_HPP
+#define PV01_ENGINE_HPP
+
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "products.hpp"
+#include "productregistry.hpp"
+
+using namespace std;
+
+// Number of coupon payments a year on a US Treasury
+const int COUPONS_PER_YEAR = 2;
+
+// One basis point of yield
+const double BASIS_POINT = 0.0001;
+
+// Face value that PV01 is quoted per
+const double PV01_FACE_VALUE = 100.0;
+
+// Date the bond universe is valued at: the 2Y, maturing 2019/11/30, is a two year note on this date
+const date VALUATION_DATE = from_string("2017/11/30");
+
+// Price, PV01 and modified duration of a bond paying _coupon for _years at _yield, per _faceValue.
+// With h = y/2, n = 2*years and v = 1/(1+h), P = F*(c/2*(1-v^n)/h + v^n), PV01 = -dP/dy * 1bp and D = -dP/dy / P.
+void ValueBond(double _yield, double _coupon, double _years, double _faceValue, double& _price, double& _pv01, double& _duration)
+{
+	double _n = round(_years * COUPONS_PER_YEAR);
+	double _h = _yield / COUPONS_PER_YEAR;
+	double _vn = pow(1.0 + _h, -_n);
+	double _vn1 = _vn / (1.0 + _h);
+
+	// the annuity factor (1-v^n)/h and its derivative with respect to h, using their limits at a zero yield
+	bool _zero = fabs(_h) < 1e-12;
+	double _annuity = _zero ? _n : (1.0 - _vn) / _h;
+	double _dAnnuity = _zero ? -_n * (_n + 1) / 2.0 : (_n * _vn1 * _h - (1.0 - _vn)) / (_h * _h);
+
+	double _c = _coupon / COUPONS_PER_YEAR;
+	_price = _faceValue * (_c * _annuity + _vn);
+	double _dPrice = _faceValue * (_c * _dAnnuity - _n * _vn1) / COUPONS_PER_YEAR;
+	_pv01 = -_dPrice * BASIS_POINT;
+	_duration = -_dPrice / _price;
+}
+
+// PV01 per _faceValue of a bond paying _coupon over _periods semi-annual periods at _yield.
+double ClosedFormPV01(double _coupon, double _yield, int _periods, double _faceValue = PV01_FACE_VALUE)
+{
+	double _price, _pv01, _duration;
+	ValueBond(_yield, _coupon, double(_periods) / COUPONS_PER_YEAR, _faceValue, _price, _pv01, _duration);
+	return _pv01;
+}
+
+// Value _count bonds from structure-of-arrays inputs one at a time.
+void ValueBondsScalar(const double* _yields, const double* _coupons, const double* _years, const double* _faceValues,
+                      double* _prices, double* _pv01s, double* _durations, size_t _count)
+{
+	for (size_t i = 0; i < _count; ++i)
+		ValueBond(_yields[i], _coupons[i], _years[i], _faceValues[i], _prices[i], _pv01s[i], _durations[i]);
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// Value bonds four at a time with AVX2. (1+h)^n is raised by binary powering on the bits of the
+// period counts, so every lane runs the same instructions; any tail of fewer than four bonds is valued scalar.
+__attribute__((target("avx2")))
+void ValueBondsAVX2(const double* _yields, const double* _coupons, const double* _years, const double* _faceValues,
+                    double* _prices, double* _pv01s, double* _durations, size_t _count)
+{
+	const __m256d _one = _mm256_set1_pd(1.0);
+	const __m256d _half = _mm256_set1_pd(1.0 / COUPONS_PER_YEAR);
+	const __m256d _perYear = _mm256_set1_pd(COUPONS_PER_YEAR);
+	const __m256d _bp = _mm256_set1_pd(BASIS_POINT);
+	const __m256d _epsilon = _mm256_set1_pd(1e-12);
+	const __m256d _absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+
+	size_t i = 0;
+	for (; i + 4 <= _count; i += 4)
+	{
+		__m256d _y = _mm256_loadu_pd(_yields + i);
+		__m256d _c = _mm256_mul_pd(_mm256_loadu_pd(_coupons + i), _half);
+		__m256d _face = _mm256_loadu_pd(_faceValues + i);
+		__m256d _n = _mm256_round_pd(_mm256_mul_pd(_mm256_loadu_pd(_years + i), _perYear), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+		__m256d _h = _mm256_mul_pd(_y, _half);
+
+		// (1+h)^n by binary powering
+		__m128i _bits = _mm256_cvtpd_epi32(_n);
+		__m256d _base = _mm256_add_pd(_one, _h);
+		__m256d _power = _one;
+		for (int b = 0; b < 31; ++b)
+		{
+			if (_mm_testz_si128(_mm_srai_epi32(_bits, b), _mm_set1_epi32(-1))) break;
+			__m128i _bit = _mm_set1_epi32(1 << b);
+			__m128i _set = _mm_cmpeq_epi32(_mm_and_si128(_bits, _bit), _bit);
+			__m256d _mask = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_set));
+			_power = _mm256_blendv_pd(_power, _mm256_mul_pd(_power, _base), _mask);
+			_base = _mm256_mul_pd(_base, _base);
+		}
+		__m256d _vn = _mm256_div_pd(_one, _power);
+		__m256d _vn1 = _mm256_div_pd(_vn, _mm256_add_pd(_one, _h));
+
+		// annuity factor and its derivative, switching to their limits where the yield is zero
+		__m256d _zero = _mm256_cmp_pd(_mm256_and_pd(_h, _absMask), _epsilon, _CMP_LT_OQ);
+		__m256d _safeH = _mm256_blendv_pd(_h, _one, _zero);
+		__m256d _oneMinusVn = _mm256_sub_pd(_one, _vn);
+		__m256d _annuity = _mm256_blendv_pd(_mm256_div_pd(_oneMinusVn, _safeH), _n, _zero);
+		__m256d _dAnnuity = _mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_mul_pd(_n, _vn1), _safeH), _oneMinusVn), _mm256_mul_pd(_safeH, _safeH));
+		__m256d _dAnnuityZero = _mm256_mul_pd(_mm256_mul_pd(_n, _mm256_add_pd(_n, _one)), _mm256_set1_pd(-0.5));
+		_dAnnuity = _mm256_blendv_pd(_dAnnuity, _dAnnuityZero, _zero);
+
+		__m256d _price = _mm256_mul_pd(_face, _mm256_add_pd(_mm256_mul_pd(_c, _annuity), _vn));
+		__m256d _negDPrice = _mm256_mul_pd(_mm256_mul_pd(_face, _half), _mm256_sub_pd(_mm256_mul_pd(_n, _vn1), _mm256_mul_pd(_c, _dAnnuity)));
+		_mm256_storeu_pd(_prices + i, _price);
+		_mm256_storeu_pd(_pv01s + i, _mm256_mul_pd(_negDPrice, _bp));
+		_mm256_storeu_pd(_durations + i, _mm256_div_pd(_negDPrice, _price));
+	}
+	ValueBondsScalar(_yields + i, _coupons + i, _years + i, _faceValues + i, _prices + i, _pv01s + i, _durations + i, _count - i);
+}
+#endif
+
+// Value _count bonds from structure-of-arrays inputs, with AVX2 when the CPU has it.
+void ValueBonds(const double* _yields, const double* _coupons, const double* _years, const double* _faceValues,
+                double* _prices, double* _pv01s, double* _durations, size_t _count)
+{
+#if defined(__GNUC__) && defined(__x86_64__)
+	static const bool _avx2 = __builtin_cpu_supports("avx2");
+	if (_avx2)
+	{
+		ValueBondsAVX2(_yields, _coupons, _years, _faceValues, _prices, _pv01s, _durations, _count);
+		return;
+	}
+#endif
+	ValueBondsScalar(_yields, _coupons, _years, _faceValues, _prices, _pv01s, _durations, _count);
+}
+
+// Get the number of semi-annual coupon periods a bond has left at VALUATION_DATE.
+int GetCouponPeriods(const Bond& _bond)
+{
+	double _years = (_bond.GetMaturityDate() - VALUATION_DATE).days() / 365.25;
+	return max(1, static_cast<int>(lround(_years * COUPONS_PER_YEAR)));
+}
+
+// Market yields for the bond universe, the curve the original PV01 table was quoted on (20Y interpolated).
+static const unordered_map<string, double> defaultYields = {
+    {"9128283H1", 0.0191},
+    {"9128283L2", 0.0226},
+    {"912828M80", 0.0261},
+    {"9128283J7", 0.0288},
+    {"9128283F5", 0.0312},
+    {"912810TW8", 0.0352},
+    {"912810RZ3", 0.0393}
+};
+
+// Get the default yield of a bond, its coupon (pricing it at par) when it is not on the curve.
+double GetDefaultYield(const Bond& _bond)
+{
+	auto it = defaultYields.find(_bond.GetProductId());
+	return it != defaultYields.end() ? it->second : _bond.GetCoupon();
+}
+
+/**
+* PV01 engine over the registered bond universe.
+* Bond terms, yields and results are held as structure-of-arrays indexed by registry index.
+* A single bond's PV01 is only recomputed when its yield has moved since it was last valued;
+* a curve move revalues every bond in one ValueBonds() batch.
+* Not synchronized, and even a read may value a bond: each thread that owns risk state needs its own engine.
+* The single-threaded service graph uses Instance(); every shard of a ShardedServiceGraph owns one.
+*/
+class PV01Engine{
+public:
+	PV01Engine() : recomputes(0){}
+	PV01Engine(const PV01Engine&) = delete;
+	PV01Engine& operator=(const PV01Engine&) = delete;
+
+	// Get the engine of the single-threaded service graph
+	static PV01Engine& Instance(){
+        static PV01Engine _engine;
+        return _engine;
+    }
+	// Get the PV01 of a registered bond at its current yield
+	double GetPV01(size_t _index){
+        Load(_index);
+        if (valuedYields[_index] != yields[_index]){
+            ValueBond(yields[_index], coupons[_index], years[_index], faceValues[_index], prices[_index], pv01s[_index], durations[_index]);
+            valuedYields[_index] = yields[_index];
+            recomputes++;
+        }
+        return pv01s[_index];
+    }
+	// Get the PV01 of a registered bond at _yield, making it the bond's current yield
+	double GetPV01(size_t _index, double _yield){
+        SetYield(_index, _yield);
+        return GetPV01(_index);
+    }
+	double GetPV01(const ProductHandle<Bond>& _bond){
+        return GetPV01(_bond.GetIndex());
+    }
+	// Get the price per face value of a registered bond at its current yield
+	double GetPrice(size_t _index){
+        GetPV01(_index);
+        return prices[_index];
+    }
+	// Get the modified duration of a registered bond at its current yield
+	double GetDuration(size_t _index){
+        GetPV01(_index);
+        return durations[_index];
+    }
+	// Move the yield of a registered bond; its PV01 is recomputed on the next read
+	void SetYield(size_t _index, double _yield){
+        Load(_index);
+        yields[_index] = _yield;
+    }
+	// Get the current yield of a registered bond
+	double GetYield(size_t _index){
+        Load(_index);
+        return yields[_index];
+    }
+	// Shift the yield of every registered bond by _shift and revalue them all in one batch
+	void ShiftCurve(double _shift){
+        LoadAll();
+        for (double& y : yields) y += _shift;
+        Revalue();
+    }
+	// Revalue every registered bond at its current yield in one batch
+	void Revalue(){
+        LoadAll();
+        ValueBonds(yields.data(), coupons.data(), years.data(), faceValues.data(), prices.data(), pv01s.data(), durations.data(), yields.size());
+        valuedYields = yields;
+        recomputes += yields.size();
+    }
+	// Get the number of bond valuations so far
+	long GetRecomputes() const{
+        return recomputes;
+    }
+private:
+	// Load the terms of every bond registered up to _index
+	void Load(size_t _index){
+        if (_index == ProductRegistry<Bond>::NOT_FOUND) throw invalid_argument("Unregistered product");
+        if (_index < yields.size()) return;
+        const ProductRegistry<Bond>& _registry = ProductRegistry<Bond>::Instance();
+        for (size_t i = yields.size(); i <= _index; ++i){
+            const Bond& _bond = _registry.Get(i);
+            coupons.push_back(_bond.GetCoupon());
+            years.push_back(double(GetCouponPeriods(_bond)) / COUPONS_PER_YEAR);
+            faceValues.push_back(PV01_FACE_VALUE);
+            yields.push_back(GetDefaultYield(_bond));
+            valuedYields.push_back(NAN);
+            prices.push_back(0);
+            pv01s.push_back(0);
+            durations.push_back(0);
+        }
+    }
+	// Load the terms of every registered bond
+	void LoadAll(){
+        size_t _size = ProductRegistry<Bond>::Instance().Size();
+        if (_size > 0) Load(_size - 1);
+    }
+
+	// inputs
+	vector<double> coupons;
+	vector<double> years;
+	vector<double> faceValues;
+	vector<double> yields;
+	vector<double> valuedYields; // yield each bond was last valued at, NAN before its first valuation
+	// outputs
+	vector<double> prices;
+	vector<double> pv01s;
+	vector<double> durations;
+	long recomputes;
+};
+
+#endif
@@ -0,0 +1,152 @@
+/**
+* recordbuffer.hpp
+* Defines a reusable output buffer that data types serialize their fields into.
+* Fields are formatted in place from numbers, so writing a record allocates nothing once
+* the buffer has grown to the size of the largest record.
+*
+*/
+#ifndef RECORD_BUFFER_HPP
+#define RECORD_BUFFER_HPP
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <charconv>
+#include <cstdio>
+#include <ctime>
+#include <cstring>
+#include <cstdint>
+#include "pricecodec.hpp"
+
+using namespace std;
+using namespace chrono;
+
+// Buffer size large enough for a formatted time stamp
+const size_t TIMESTAMP_BUFFER_SIZE = 32;
+
+/**
+* Formats wall-clock times with millisecond precision (e.g. "2023-12-20 10:15:30.123").
+* The "date time." prefix is cached and only rebuilt through localtime_r when the second changes,
+* so most calls just write three digits. Keep one formatter per thread.
+*/
+class TimeStampFormatter{
+public:
+	// Write the time _nanoseconds after the epoch into _buffer (at least TIMESTAMP_BUFFER_SIZE chars), returning the length written
+	size_t Format(int64_t _nanoseconds, char* _buffer){
+        int64_t _second = _nanoseconds / 1000000000;
+        long _millisec = static_cast<long>(_nanoseconds / 1000000 % 1000);
+        if (_second != cachedSecond){
+            time_t _timeT = static_cast<time_t>(_second);
+            tm _timeTm;
+            localtime_r(&_timeT, &_timeTm);
+            prefixSize = strftime(prefix, sizeof(prefix), "%F %T", &_timeTm);
+            prefix[prefixSize++] = '.';
+            cachedSecond = _second;
+        }
+        memcpy(_buffer, prefix, prefixSize);
+        size_t _size = prefixSize;
+        _buffer[_size++] = static_cast<char>('0' + _millisec / 100);
+        _buffer[_size++] = static_cast<char>('0' + _millisec / 10 % 10);
+        _buffer[_size++] = static_cast<char>('0' + _millisec % 10);
+        return _size;
+    }
+	size_t Format(system_clock::time_point _timePoint, char* _buffer){
+        return Format(duration_cast<nanoseconds>(_timePoint.time_since_epoch()).count(), _buffer);
+    }
+private:
+	int64_t cachedSecond = -1;
+	char prefix[TIMESTAMP_BUFFER_SIZE];
+	size_t prefixSize = 0;
+};
+
+// Write a time stamp with millisecond precision and a trailing space (e.g. "2023-12-20 10:15:30.123 ") into _buffer, returning the length written.
+size_t WriteTimeStamp(system_clock::time_point _timePoint, char* _buffer)
+{
+	thread_local TimeStampFormatter _formatter;
+	size_t _size = _formatter.Format(_timePoint, _buffer);
+	_buffer[_size++] = ' ';
+	return _size;
+}
+
+/**
+* Reusable buffer holding one comma-separated record.
+* Each Write*() call appends a field followed by a comma, formatted the way ToStrings() formats it.
+*/
+class RecordBuffer{
+public:
+	// ctor reserving room for a typical record
+	explicit RecordBuffer(size_t _capacity = 256){
+        data.reserve(_capacity);
+    }
+	// Empty the buffer, keeping its capacity
+	void Clear(){
+        data.clear();
+    }
+	// Append raw bytes
+	void Append(const char* _bytes, size_t _size){
+        data.append(_bytes, _size);
+    }
+	void Append(string_view _text){
+        data.append(_text.data(), _text.size());
+    }
+	void Append(char _c){
+        data.push_back(_c);
+    }
+	// Overwrite bytes already appended, starting at _offset
+	void Replace(size_t _offset, const char* _bytes, size_t _size){
+        data.replace(_offset, _size, _bytes, _size);
+    }
+	// Append the current time stamp
+	void AppendTimeStamp(){
+        char _stamp[TIMESTAMP_BUFFER_SIZE];
+        Append(_stamp, WriteTimeStamp(system_clock::now(), _stamp));
+    }
+	// Append an integer
+	void AppendInteger(long _value){
+        char _digits[24];
+        Append(_digits, to_chars(_digits, _digits + sizeof(_digits), _value).ptr - _digits);
+    }
+	// Append a number the way an ostream does by default, with six significant digits
+	void AppendNumber(double _value){
+        char _digits[64];
+        int _size = snprintf(_digits, sizeof(_digits), "%g", _value);
+        Append(_digits, static_cast<size_t>(_size) < sizeof(_digits) ? _size : sizeof(_digits) - 1);
+    }
+	// Write a text field
+	void WriteField(string_view _text){
+        Append(_text);
+        Append(',');
+    }
+	// Write an integer field
+	void WriteInteger(long _value){
+        AppendInteger(_value);
+        Append(',');
+    }
+	// Write a decimal field with six decimal places, as to_string(double) does
+	void WriteDecimal(double _value){
+        char _digits[64];
+        int _size = snprintf(_digits, sizeof(_digits), "%f", _value);
+        Append(_digits, static_cast<size_t>(_size) < sizeof(_digits) ? _size : sizeof(_digits) - 1);
+        Append(',');
+    }
+	// Write a price field in fractional notation, as ConvertPrice(double) does
+	void WritePrice(double _price){
+        char _digits[PRICE_BUFFER_SIZE];
+        Append(_digits, FormatPriceTicks(PriceToTicks(_price), _digits));
+        Append(',');
+    }
+	// Get the record
+	const char* Data() const{
+        return data.data();
+    }
+	size_t Size() const{
+        return data.size();
+    }
+	string_view View() const{
+        return string_view(data);
+    }
+private:
+	string data;
+};
+
+#endif
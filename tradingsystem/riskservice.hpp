@@ -9,8 +9,37 @@
 #ifndef RISK_SERVICE_HPP
 #define RISK_SERVICE_HPP
 
+#include <unordered_map>
+#include <cmath>
+#include <cstdint>
 #include "soa.hpp"
 #include "positionservice.hpp"
+#include "pv01engine.hpp"
+
+/**
+* A bucket sector to bucket a group of securities.
+* We can then aggregate bucketed risk to this bucket.
+* Type T is the product type.
+*/
+template<typename T>
+class BucketedSector{
+public:
+	BucketedSector() = default;
+	// ctor for a sector of registered products; throws if one is not registered
+	BucketedSector(const vector<T>& _products, string _name){
+        for (auto& p : _products) products.push_back(ProductHandle<T>(p));
+        name = _name;
+    }
+	const vector<ProductHandle<T>>& GetProducts() const{
+        return products;
+    }
+	const string& GetName() const{
+        return name;
+    }
+private:
+	vector<ProductHandle<T>> products;
+	string name;
+};
 
 /**
 * PV01 risk.
@@ -21,12 +50,16 @@ class PV01{
 public:
 	// ctor for a PV01 value
 	PV01() = default;
-	PV01(const T& _product, double _pv01, long _quantity){
+	PV01(ProductHandle<T> _product, double _pv01, long _quantity){
         product = _product;
         pv01 = _pv01;
         quantity = _quantity;
     }
 	const T& GetProduct() const{
+        return product.Get();
+    }
+	// Get the handle onto the registered product
+	ProductHandle<T> GetProductHandle() const{
         return product;
     }
 	double GetPV01() const{
@@ -38,49 +71,75 @@ public:
 	// Set the quantity that this risk value is associated with
 	void SetQuantity(long _quantity){
         quantity = _quantity;
+    }
+	// Set the pv01 value
+	void SetPV01(double _pv01){
+        pv01 = _pv01;
     }
 	vector<string> ToStrings() const{
         vector<string> _strings;
-        _strings.push_back(product.GetProductId());
+        _strings.push_back(product.Get().GetProductId());
         _strings.push_back(to_string(pv01));
         _strings.push_back(to_string(quantity));
         return _strings;
     }
+	// Write the fields ToStrings() returns into _buffer
+	void WriteTo(RecordBuffer& _buffer) const{
+        _buffer.WriteField(product.Get().GetProductId());
+        _buffer.WriteDecimal(pv01);
+        _buffer.WriteInteger(quantity);
+    }
 
 private:
-	T product;
+	ProductHandle<T> product;
 	double pv01;
 	long quantity;
 };
 
-
 /**
-* A bucket sector to bucket a group of securities.
-* We can then aggregate bucketed risk to this bucket.
-* Type T is the product type.
+* PV01 risk of a bucket sector, which is not a registered product and so is held by value.
+* Type T is the product type of the sector's securities.
 */
 template<typename T>
-class BucketedSector{
+class PV01<BucketedSector<T>>{
 public:
-	BucketedSector() = default;
-	BucketedSector(const vector<T>& _products, string _name){
-        products = _products;
-        name = _name;
+	// ctor for a PV01 value
+	PV01() = default;
+	PV01(const BucketedSector<T>& _sector, double _pv01, long _quantity){
+        sector = _sector;
+        pv01 = _pv01;
+        quantity = _quantity;
     }
-	const vector<T>& GetProducts() const{
-        return products;
+	const BucketedSector<T>& GetProduct() const{
+        return sector;
     }
-	const string& GetName() const{
-        return name;
+	double GetPV01() const{
+        return pv01;
+    }
+	long GetQuantity() const{
+        return quantity;
     }
+	// Set the quantity that this risk value is associated with
+	void SetQuantity(long _quantity){
+        quantity = _quantity;
+    }
+	// Set the pv01 value
+	void SetPV01(double _pv01){
+        pv01 = _pv01;
+    }
+
 private:
-	vector<T> products;
-	string name;
+	BucketedSector<T> sector;
+	double pv01;
+	long quantity;
 };
 
 template<typename T>
 class RiskListenerFromPosition;
 
+// Units of pv01 x quantity per unit of a sector's running total, which is kept as an integer so it never drifts
+const double SECTOR_EXPOSURE_SCALE = 1e8;
+
 /**
 * Risk Service to vend out risk for a particular security and across a risk bucketed sector.
 * Keyed on product identifier.
@@ -89,22 +148,27 @@ class RiskListenerFromPosition;
 template<typename T>
 class RiskService : public Service<string, PV01<T>>{
 private:
-	map<string, PV01<T>> PidPv01Map;  // product id -> pv01 value
+	ProductTable<T, PV01<T>> PidPv01Map;  // product index -> pv01 value
+	vector<PV01<BucketedSector<T>>> sectorRisks; // pv01 x quantity per registered sector
+	vector<int64_t> sectorExposures;             // running pv01 x quantity per registered sector, in 1e-8 units
+	unordered_map<string, size_t> sectorIds;     // sector name -> sector id
+	ProductTable<T, vector<size_t>> productSectors; // product index -> ids of the sectors holding it
 	vector<ServiceListener<PV01<T>>*> listeners;
 	RiskListenerFromPosition<T>* listener;
+	PV01Engine* engine;  // owned by the thread calling this service
 public:
-	// Constructor and destructor
-	RiskService(){
+	// Constructor and destructor, valuing bonds with _engine
+	explicit RiskService(PV01Engine& _engine = PV01Engine::Instance()) : engine(&_engine){
         listener = new RiskListenerFromPosition<T>(this);
     }
 	~RiskService() = default;
 	PV01<T>& GetData(string _key){
-        return PidPv01Map[_key];
+        return PidPv01Map.At(_key);
     }
 	void OnMessage(PV01<T>& _data){
-        PidPv01Map[_data.GetProduct().GetProductId()] = _data;
+        Store(_data.GetProductHandle().GetIndex(), _data);
         for (auto& l : listeners){
-            l->ProcessUpdate(_data);
+            l->ProcessAdd(_data);
         }
     }
 	void AddListener(ServiceListener<PV01<T>>* _listener){
@@ -118,32 +182,89 @@ public:
     }
 	// Add a position that the service will risk
     void AddPosition(Position<T>& _position) {
-        const T& _product = _position.GetProduct(); // Use reference
-        const string& _productId = _product.GetProductId(); // Use reference if possible
-        double _pv01Value = GetPV01Value(_productId);
+        ProductHandle<T> _product = _position.GetProductHandle();
+        double _pv01Value = engine->GetPV01(_product);
         long _quantity = _position.GetAggregatePosition();
 
-        // Utilize move semantics if applicable for PV01 constructor
-        PV01<T> _pv01(_product, _pv01Value, _quantity);
-        PidPv01Map[_productId] = std::move(_pv01); // Use move assignment if PV01 is movable
-        OnMessage(PidPv01Map[_productId]);
+        // Store by the index the connector resolved, then notify listeners
+        PV01<T>& _pv01 = Store(_product.GetIndex(), PV01<T>(_product, _pv01Value, _quantity));
+        for (auto& l : listeners){
+            l->ProcessAdd(_pv01);
+        }
     }
 
-    // Get the bucketed risk for the bucket sector
-	const PV01<BucketedSector<T>>& GetBucketedRisk(const BucketedSector<T>& _sector) const{
-        BucketedSector<T> _product = _sector;
-        double _pv01 = 0;
-        long _quantity = 1;
-
-        vector<T>& _products = _sector.GetProducts();
-        for (auto& p : _products){
-            string _pId = p.GetProductId();
-            _pv01 += PidPv01Map[_pId].GetPV01() * PidPv01Map[_pId].GetQuantity();
+	// Shift the whole yield curve by _shift, revalue every bond in one batch and re-risk every position held
+	void OnCurveShift(double _shift){
+        PV01Engine& _engine = *engine;
+        _engine.ShiftCurve(_shift);
+        size_t _size = ProductRegistry<T>::Instance().Size();
+        for (size_t i = 0; i < _size; ++i){
+            if (PV01<T>* _pv01 = PidPv01Map.Find(i)) _pv01->SetPV01(_engine.GetPV01(i));
+        }
+        // every product moved, so sum the sectors afresh rather than applying a delta per product
+        for (size_t _id = 0; _id < sectorRisks.size(); ++_id) SetSectorExposure(_id, SectorTotal(sectorRisks[_id].GetProduct()));
+        for (size_t i = 0; i < _size; ++i){
+            PV01<T>* _pv01 = PidPv01Map.Find(i);
+            if (!_pv01) continue;
+            for (auto& l : listeners){
+                l->ProcessAdd(*_pv01);
+            }
         }
-
-        return PV01<BucketedSector<T>>(_product, _pv01, _quantity);
     }
 
+	// Register a sector whose risk is kept as a running total, returning its id; registering a name again returns the existing id
+	size_t RegisterSector(const BucketedSector<T>& _sector){
+        auto it = sectorIds.find(_sector.GetName());
+        if (it != sectorIds.end()) return it->second;
+
+        size_t _id = sectorRisks.size();
+        for (auto& p : _sector.GetProducts()) productSectors[p.GetIndex()].push_back(_id);
+        sectorRisks.push_back(PV01<BucketedSector<T>>(_sector, 0.0, 1));
+        sectorExposures.push_back(0);
+        SetSectorExposure(_id, SectorTotal(_sector));
+        sectorIds[_sector.GetName()] = _id;
+        return _id;
+    }
+	// Get the bucketed risk of a registered sector
+	const PV01<BucketedSector<T>>& GetBucketedRisk(size_t _sectorId) const{
+        return sectorRisks[_sectorId];
+    }
+	// Get the bucketed risk for the bucket sector, registering it on first sight
+	const PV01<BucketedSector<T>>& GetBucketedRisk(const BucketedSector<T>& _sector){
+        return sectorRisks[RegisterSector(_sector)];
+    }
+private:
+	// Get the pv01 x quantity a product contributes to its sectors, in 1e-8 units; the same risk always
+	// gives the same integer, so taking a product's old exposure back out of a total leaves no residue
+	static int64_t Exposure(const PV01<T>& _pv01){
+        return llround(_pv01.GetPV01() * _pv01.GetQuantity() * SECTOR_EXPOSURE_SCALE);
+    }
+	// Set a sector's running total, in 1e-8 units
+	void SetSectorExposure(size_t _id, int64_t _exposure){
+        sectorExposures[_id] = _exposure;
+        sectorRisks[_id].SetPV01(_exposure / SECTOR_EXPOSURE_SCALE);
+    }
+	// Sum the pv01 x quantity of a sector's products from the stored risks, in 1e-8 units
+	int64_t SectorTotal(const BucketedSector<T>& _sector){
+        int64_t _total = 0;
+        for (auto& p : _sector.GetProducts()){
+            size_t _index = p.GetIndex();
+            if (const PV01<T>* _pv01 = PidPv01Map.Find(_index)) _total += Exposure(*_pv01);
+        }
+        return _total;
+    }
+	// Store a product's risk and move the totals of the sectors holding it by the change in its exposure
+	PV01<T>& Store(size_t _index, const PV01<T>& _pv01){
+        const PV01<T>* _previous = PidPv01Map.Find(_index);
+        int64_t _old = _previous ? Exposure(*_previous) : 0;
+        PV01<T>& _stored = PidPv01Map[_index];
+        _stored = _pv01;
+        if (const vector<size_t>* _sectors = productSectors.Find(_index)){
+            int64_t _delta = Exposure(_pv01) - _old;
+            for (size_t _id : *_sectors) SetSectorExposure(_id, sectorExposures[_id] + _delta);
+        }
+        return _stored;
+    }
 };
 
 
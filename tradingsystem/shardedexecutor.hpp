@@ -0,0 +1,337 @@
+/**
+* shardedexecutor.hpp
+* Defines an executor that runs keyed events on a fixed set of worker threads, every key always on the
+* same worker, and a sharded copy of the per-product service graph built on it.
+*
+*/
+#ifndef SHARDED_EXECUTOR_HPP
+#define SHARDED_EXECUTOR_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include "soa.hpp"
+#include "spscqueue.hpp"
+#include "parallelloader.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "streamingservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "inquiryservice.hpp"
+#include "pv01engine.hpp"
+
+using namespace std;
+
+// Events each producer can have queued for one shard before it waits
+const size_t SHARD_RING_SIZE = 4096;
+
+// Events a worker takes from one lane before it looks at the next
+const size_t SHARD_POLL_BATCH = 64;
+
+/**
+* A stream of events of one type from one producer thread, fanned out to the shards.
+*/
+class ShardLaneBase{
+public:
+	virtual ~ShardLaneBase() = default;
+	// Handle up to SHARD_POLL_BATCH events queued for _shard, returning how many were handled
+	virtual size_t Poll(size_t _shard) = 0;
+	// Whether the producer has closed the lane and _shard has handled everything queued for it
+	virtual bool Drained(size_t _shard) const = 0;
+	// Wait until every shard has handled every event submitted so far (producer only)
+	virtual void Settle() = 0;
+};
+
+/**
+* Events of type E from one producer thread, each handed to the shard owning its key through that shard's
+* single-producer/single-consumer ring, so the events for a key reach its shard in the order they were submitted.
+* The shard's worker calls _handler(shard, event). Type Handler is called concurrently for different shards.
+*/
+template<typename E, typename Handler>
+class ShardLane final : public ShardLaneBase{
+public:
+	ShardLane(size_t _shards, size_t _capacity, Handler& _handler)
+        : handler(_handler), scratch(_shards), submitted(_shards, 0), handled(new atomic<long>[_shards]){
+        for (size_t i = 0; i < _shards; ++i){
+            rings.push_back(make_unique<SPSCQueue<E>>(_capacity));
+            handled[i].store(0, memory_order_relaxed);
+        }
+    }
+	// Queue an event for the shard owning _key, waiting while that shard's ring is full (producer only)
+	void Submit(size_t _key, const E& _event){
+        size_t _shard = _key % rings.size();
+        rings[_shard]->Push(_event);
+        submitted[_shard]++;
+    }
+	// Mark the end of the stream (producer only)
+	void Close(){
+        for (auto& r : rings) r->Close();
+    }
+	size_t Poll(size_t _shard) override{
+        SPSCQueue<E>& _ring = *rings[_shard];
+        E& _event = scratch[_shard];
+        size_t _handled = 0;
+        while (_handled < SHARD_POLL_BATCH && _ring.TryPop(_event)){
+            handler(_shard, _event);
+            _handled++;
+        }
+        if (_handled > 0) handled[_shard].fetch_add(_handled, memory_order_release);
+        return _handled;
+    }
+	bool Drained(size_t _shard) const override{
+        return rings[_shard]->Drained();
+    }
+	void Settle() override{
+        for (size_t s = 0; s < rings.size(); ++s){
+            while (handled[s].load(memory_order_acquire) < submitted[s]) this_thread::yield();
+        }
+    }
+private:
+	Handler& handler;
+	vector<unique_ptr<SPSCQueue<E>>> rings;     // one per shard
+	vector<E> scratch;                          // per shard, the event being handled
+	vector<long> submitted;                     // per shard, events submitted, owned by the producer
+	unique_ptr<atomic<long>[]> handled;         // per shard, events handled
+};
+
+/**
+* Runs keyed events on one worker thread per shard.
+* Key k always belongs to shard k % shards, so state keyed the same way (e.g. per-product tables indexed by
+* the product registry index, which is a dense perfect hash of the product id) is only ever touched by one
+* thread and needs no locks. Each producer thread submits through its own lane; a worker polls its ring in
+* every lane and stops once every lane is closed and drained. Add the lanes, then Start(), then Join().
+*/
+class ShardedExecutor{
+public:
+	explicit ShardedExecutor(size_t _shards, size_t _capacity = SHARD_RING_SIZE)
+        : shards(max<size_t>(_shards, 1)), capacity(_capacity), processed(shards){}
+	~ShardedExecutor(){
+        Join();
+    }
+	ShardedExecutor(const ShardedExecutor&) = delete;
+	ShardedExecutor& operator=(const ShardedExecutor&) = delete;
+
+	// Add a lane for events of type E handled by _handler(shard, event); call before Start()
+	template<typename E, typename Handler>
+	ShardLane<E, Handler>& AddLane(Handler& _handler){
+        auto _lane = make_unique<ShardLane<E, Handler>>(shards, capacity, _handler);
+        ShardLane<E, Handler>& _ref = *_lane;
+        lanes.push_back(move(_lane));
+        return _ref;
+    }
+	// Start one worker per shard
+	void Start(){
+        for (size_t s = 0; s < shards; ++s) workers.emplace_back(&ShardedExecutor::Run, this, s);
+    }
+	// Wait until every lane has been closed and drained
+	void Join(){
+        for (auto& w : workers) w.join();
+        workers.clear();
+    }
+	// Get the number of shards
+	size_t GetShards() const{
+        return shards;
+    }
+	// Get the shard owning _key
+	size_t ShardOf(size_t _key) const{
+        return _key % shards;
+    }
+	// Wait until every shard has handled every event submitted so far; call from the one thread feeding every lane
+	void Settle(){
+        for (auto& l : lanes) l->Settle();
+    }
+	// Get the number of events each shard has handled; read after Join()
+	const vector<long>& GetProcessed() const{
+        return processed;
+    }
+private:
+	// Worker loop: poll every lane's ring for the shard, yielding when there is nothing to do
+	void Run(size_t _shard){
+        long _events = 0;
+        while (true){
+            size_t _handled = 0;
+            for (auto& l : lanes) _handled += l->Poll(_shard);
+            _events += _handled;
+            if (_handled > 0) continue;
+            bool _drained = true;
+            for (auto& l : lanes) _drained = _drained && l->Drained(_shard);
+            if (_drained) break;
+            this_thread::yield();
+        }
+        processed[_shard] = _events;
+    }
+
+	size_t shards;
+	size_t capacity;
+	vector<unique_ptr<ShardLaneBase>> lanes;
+	vector<thread> workers;
+	vector<long> processed;
+};
+
+/**
+* Consumers that see every product, shared by all shards and called from every shard's thread,
+* so each must be safe to call concurrently (e.g. the GUI service, a historical data listener, or a BoundedEdge).
+* A null listener is left out.
+*/
+template<typename T>
+struct ShardSinks{
+	ServiceListener<Price<T>>* prices = nullptr;
+	ServiceListener<PriceStream<T>>* streams = nullptr;
+	ServiceListener<ExecutionOrder<T>>* executions = nullptr;
+	ServiceListener<Position<T>>* positions = nullptr;
+	ServiceListener<PV01<T>>* risk = nullptr;
+	ServiceListener<Inquiry<T>>* inquiries = nullptr;
+};
+
+/**
+* The per-product services of one shard, linked as in main.cpp.
+* Only products owned by the shard reach these services, so their per-product tables, object pools,
+* book registry, PV01 engine and counters are private to the shard's thread.
+* Type T is the product type.
+*/
+template<typename T>
+class ServiceShard{
+public:
+	ServiceShard(const ShardSinks<T>& _sinks, int _bookDepth) : risk(engine){
+        marketData.SetBookDepth(_bookDepth);
+        pricing.AddListener(algoStreaming.GetListener());
+        if (_sinks.prices) pricing.AddListener(_sinks.prices);
+        algoStreaming.AddListener(streaming.GetListener());
+        if (_sinks.streams) streaming.AddListener(_sinks.streams);
+        marketData.AddListener(algoExecution.GetListener());
+        algoExecution.AddListener(execution.GetListener());
+        if (_sinks.executions) execution.AddListener(_sinks.executions);
+        execution.AddListener(tradeBooking.GetListener());
+        tradeBooking.AddListener(position.GetListener());
+        position.AddListener(risk.GetListener());
+        if (_sinks.positions) position.AddListener(_sinks.positions);
+        if (_sinks.risk) risk.AddListener(_sinks.risk);
+        if (_sinks.inquiries) inquiry.AddListener(_sinks.inquiries);
+    }
+
+	PV01Engine engine;      // declared before the risk service valuing with it
+	PricingService<T> pricing;
+	TradeBookingService<T> tradeBooking;
+	PositionService<T> position;
+	RiskService<T> risk;
+	MarketDataService<T> marketData;
+	AlgoExecutionService<T> algoExecution;
+	AlgoStreamingService<T> algoStreaming;
+	ExecutionService<T> execution;
+	StreamingService<T> streaming;
+	InquiryService<T> inquiry;
+};
+
+/**
+* The service graph of main.cpp split into shards by product.
+* Each feed is parsed on the thread calling its Feed*() method and every event is submitted to the shard
+* owning its product, where the shard's own copy of the services processes it; per-product order is kept,
+* products on different shards run in parallel. Consumers of every product (GUI, historical data) are merged
+* through the shared ShardSinks, and bucketed risk is merged by summing the shards' running sector totals.
+* The services' alternating counters (streaming quantities, execution sides, trade books) are kept per product,
+* so every product sees the same sequence whichever shard runs it. Fed one file at a time with Settle() in
+* between, as main.cpp does under --sequential, the graph writes the same records per product as the single graph.
+* Register the universe before construction. Type T is the product type.
+*/
+template<typename T>
+class ShardedServiceGraph{
+public:
+	typedef typename MarketDataConnector<T>::OrderLine OrderLine;
+
+	ShardedServiceGraph(size_t _shards, const ShardSinks<T>& _sinks, int _bookDepth = 5) : executor(_shards){
+        for (size_t s = 0; s < executor.GetShards(); ++s) shards.push_back(make_unique<ServiceShard<T>>(_sinks, _bookDepth));
+        priceLane = &executor.template AddLane<Price<T>>(*this);
+        tradeLane = &executor.template AddLane<Trade<T>>(*this);
+        orderLane = &executor.template AddLane<OrderLine>(*this);
+        inquiryLane = &executor.template AddLane<Inquiry<T>>(*this);
+    }
+
+	// Register a bucketed sector on every shard, returning its id
+	size_t RegisterSector(const BucketedSector<T>& _sector){
+        size_t _id = 0;
+        for (auto& s : shards) _id = s->risk.RegisterSector(_sector);
+        return _id;
+    }
+	// Start the shards, valuing each shard's PV01 engine up front in one batch
+	void Start(){
+        for (auto& s : shards) s->engine.Revalue();
+        executor.Start();
+    }
+	// Wait until every feed has been processed
+	void Join(){
+        executor.Join();
+    }
+	// Wait until every event fed so far has been processed, so the next feed starts after it; call from the one thread feeding every file
+	void Settle(){
+        executor.Settle();
+    }
+
+	// Feed each file from one thread, parsing on _parseThreads threads
+	void FeedPrices(const string& _path, size_t _parseThreads = 1){
+        Feed(_path, _parseThreads, *priceLane, &PricingConnector<T>::ParseLine);
+    }
+	void FeedTrades(const string& _path, size_t _parseThreads = 1){
+        Feed(_path, _parseThreads, *tradeLane, &TradeBookingConnector<T>::ParseLine);
+    }
+	void FeedMarketData(const string& _path, size_t _parseThreads = 1){
+        Feed(_path, _parseThreads, *orderLane, &MarketDataConnector<T>::ParseLine);
+    }
+	void FeedInquiries(const string& _path, size_t _parseThreads = 1){
+        Feed(_path, _parseThreads, *inquiryLane, &InquiryConnector<T>::ParseLine);
+    }
+
+	// Get a sector's risk summed over the shards
+	double GetBucketedRisk(size_t _sectorId) const{
+        double _total = 0;
+        for (auto& s : shards) _total += s->risk.GetBucketedRisk(_sectorId).GetPV01();
+        return _total;
+    }
+	// Get the number of shards
+	size_t GetShards() const{
+        return shards.size();
+    }
+	ServiceShard<T>& GetShard(size_t _shard){
+        return *shards[_shard];
+    }
+	const vector<long>& GetProcessed() const{
+        return executor.GetProcessed();
+    }
+
+	// Handle an event on the shard owning its product
+	void operator()(size_t _shard, Price<T>& _price){ shards[_shard]->pricing.OnMessage(_price); }
+	void operator()(size_t _shard, Trade<T>& _trade){ shards[_shard]->tradeBooking.OnMessage(_trade); }
+	void operator()(size_t _shard, OrderLine& _order){
+        shards[_shard]->marketData.GetConnector()->AddOrder(_order.product, _order.price, _order.quantity, _order.side);
+    }
+	void operator()(size_t _shard, Inquiry<T>& _inquiry){ shards[_shard]->inquiry.OnMessage(_inquiry); }
+
+private:
+	template<typename E, typename Parse>
+	void Feed(const string& _path, size_t _parseThreads, ShardLane<E, ShardedServiceGraph>& _lane, Parse _parse){
+        try{
+            ParallelLoader<E>(_parseThreads).Load(_path, _parse, [&](E& _event) { _lane.Submit(_event.GetProductHandle().GetIndex(), _event); });
+        }
+        catch (...){
+            // close the lane anyway, so the shards still finish
+            _lane.Close();
+            throw;
+        }
+        _lane.Close();
+    }
+
+	vector<unique_ptr<ServiceShard<T>>> shards;
+	ShardedExecutor executor;       // declared after the shards, so its workers are joined before the shards go
+	ShardLane<Price<T>, ShardedServiceGraph>* priceLane;
+	ShardLane<Trade<T>, ShardedServiceGraph>* tradeLane;
+	ShardLane<OrderLine, ShardedServiceGraph>* orderLane;
+	ShardLane<Inquiry<T>, ShardedServiceGraph>* inquiryLane;
+};
+
+#endif
@@ -11,10 +11,16 @@
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <deque>
 #include <map>
 #include <unordered_map>
+#include <tuple>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
 #include "products.hpp"
 #include "functions.hpp"
+#include "productregistry.hpp"
 
 using namespace std;
 
@@ -38,6 +44,84 @@ public:
 
 };
 
+/**
+* Forwards events to the listeners registered on a Service through the virtual ServiceListener interface.
+* This is the sink a Service publishes to unless it is given a compile-time one.
+*/
+template<typename V>
+class VirtualListeners
+{
+
+public:
+
+	explicit VirtualListeners(const vector<ServiceListener<V>*>& _listeners) : listeners(_listeners) {}
+
+	void ProcessAdd(V& _data) { for (auto& l : listeners) l->ProcessAdd(_data); }
+
+	void ProcessRemove(V& _data) { for (auto& l : listeners) l->ProcessRemove(_data); }
+
+	void ProcessUpdate(V& _data) { for (auto& l : listeners) l->ProcessUpdate(_data); }
+
+private:
+	const vector<ServiceListener<V>*>& listeners;
+
+};
+
+/**
+* A list of listeners fixed at compile time.
+* Events are forwarded to each listener through its concrete type, so for final listener classes
+* the calls are direct and the whole chain can be inlined.
+*/
+template<typename... Ls>
+class ListenerList
+{
+
+public:
+
+	explicit ListenerList(Ls&... _listeners) : listeners(_listeners...) {}
+
+	template<typename V>
+	void ProcessAdd(V& _data) { apply([&](auto&... l) { (l.ProcessAdd(_data), ...); }, listeners); }
+
+	template<typename V>
+	void ProcessRemove(V& _data) { apply([&](auto&... l) { (l.ProcessRemove(_data), ...); }, listeners); }
+
+	template<typename V>
+	void ProcessUpdate(V& _data) { apply([&](auto&... l) { (l.ProcessUpdate(_data), ...); }, listeners); }
+
+private:
+	tuple<Ls&...> listeners;
+
+};
+
+/**
+* A listener bound to the compile-time sink its own Service publishes to.
+* Chaining these composes a pipeline of Services whose types are all known to the compiler.
+* Type L is the listener type, which must provide ProcessAdd(V&, Sink&).
+*/
+template<typename L, typename Sink>
+class ChainedListener
+{
+
+public:
+
+	ChainedListener(L& _listener, Sink& _sink) : listener(_listener), sink(_sink) {}
+
+	template<typename V>
+	void ProcessAdd(V& _data) { listener.ProcessAdd(_data, sink); }
+
+	template<typename V>
+	void ProcessRemove(V& _data) {}
+
+	template<typename V>
+	void ProcessUpdate(V& _data) {}
+
+private:
+	L& listener;
+	Sink& sink;
+
+};
+
 /**
 * Definition of a generic base class Service.
 * Uses key generic type K and value generic type V.
@@ -48,7 +132,7 @@ class Service
 
 public:
 
-	// Get data on our service given a key
+	// Get data on our service given a key; services keeping it in a ProductTable throw out_of_range if none is stored
 	virtual V& GetData(K _key) = 0;
 
 	// The callback that a Connector should invoke for any new or updated data
@@ -62,6 +146,338 @@ public:
 
 };
 
+/**
+* Dense storage backend for Service state keyed on product.
+* Values live in a vector indexed by product registry index: the product identifier is resolved
+* to an index once (at the connector, via ProductHandle) and every later lookup is an array access.
+* Lookup by product identifier is kept so GetData(string) still works.
+* operator[] adds a default value on first access and is for writes; reads go through Find() or At(),
+* which never add one, so Contains() means a value has been stored.
+* Type T is the product type and V the value type.
+*/
+template<typename T, typename V>
+class ProductTable
+{
+
+public:
+
+	// ctor sized for every product registered so far
+	ProductTable() : values(ProductRegistry<T>::Instance().Size()), present(values.size(), false) {}
+
+	// Get the value for a product index to write, adding a default value on first access
+	V& operator[](size_t _index)
+	{
+		if (_index == ProductRegistry<T>::NOT_FOUND) throw invalid_argument("Unregistered product");
+		if (_index >= values.size())
+		{
+			values.resize(_index + 1);
+			present.resize(_index + 1, false);
+		}
+		present[_index] = true;
+		return values[_index];
+	}
+
+	// Get the value for a product handle
+	V& operator[](const ProductHandle<T>& _product)
+	{
+		return (*this)[_product.GetIndex()];
+	}
+
+	// Get the value for a product identifier
+	V& operator[](string_view _productId)
+	{
+		size_t _index = ProductRegistry<T>::Instance().Find(_productId);
+		if (_index == ProductRegistry<T>::NOT_FOUND) throw invalid_argument("Unknown product " + string(_productId));
+		return (*this)[_index];
+	}
+
+	// Whether a value has been stored for a product index
+	bool Contains(size_t _index) const
+	{
+		return _index < present.size() && present[_index];
+	}
+
+	// Get the value stored for a product index, or nullptr if there is none
+	V* Find(size_t _index)
+	{
+		return Contains(_index) ? &values[_index] : nullptr;
+	}
+
+	const V* Find(size_t _index) const
+	{
+		return Contains(_index) ? &values[_index] : nullptr;
+	}
+
+	// Get the value stored for a product identifier, or nullptr if there is none
+	V* Find(string_view _productId)
+	{
+		return Find(ProductRegistry<T>::Instance().Find(_productId));
+	}
+
+	const V* Find(string_view _productId) const
+	{
+		return Find(ProductRegistry<T>::Instance().Find(_productId));
+	}
+
+	// Get the value stored for a product index; throws out_of_range if there is none
+	V& At(size_t _index)
+	{
+		V* _value = Find(_index);
+		if (!_value) throw out_of_range("No data for product index " + to_string(_index));
+		return *_value;
+	}
+
+	const V& At(size_t _index) const
+	{
+		const V* _value = Find(_index);
+		if (!_value) throw out_of_range("No data for product index " + to_string(_index));
+		return *_value;
+	}
+
+	// Get the value stored for a product identifier; throws out_of_range if there is none
+	V& At(string_view _productId)
+	{
+		V* _value = Find(_productId);
+		if (!_value) throw out_of_range("No data for product " + string(_productId));
+		return *_value;
+	}
+
+	const V& At(string_view _productId) const
+	{
+		const V* _value = Find(_productId);
+		if (!_value) throw out_of_range("No data for product " + string(_productId));
+		return *_value;
+	}
+
+private:
+	vector<V> values;
+	vector<bool> present;
+
+};
+
+/**
+* Sink delivering events to a Service through its OnMessage() callback, the way a subscribing Connector does.
+*/
+template<typename K, typename V>
+class ServiceSink
+{
+
+public:
+
+	explicit ServiceSink(Service<K, V>& _service) : service(_service) {}
+
+	void ProcessAdd(V& _data) { service.OnMessage(_data); }
+
+	void ProcessRemove(V& _data) {}
+
+	void ProcessUpdate(V& _data) { service.OnMessage(_data); }
+
+private:
+	Service<K, V>& service;
+
+};
+
+// Whether data type V is a view onto state its service keeps (it declares the type it views as ViewOf),
+// so a copy taken now reads that state later and must not be queued for another thread
+template<typename V, typename = void>
+struct IsStoreView : false_type {};
+template<typename V>
+struct IsStoreView<V, void_t<typename V::ViewOf>> : true_type {};
+
+// Conflation key of a data type: the registry index of its product
+struct ProductIndexOf
+{
+	template<typename V>
+	auto operator()(const V& _data) const -> decltype(_data.GetProductHandle().GetIndex()) { return _data.GetProductHandle().GetIndex(); }
+};
+
+/**
+* Latest value per key, kept in the order the keys first became pending.
+* A value offered for a key that is still pending replaces it, along with whether it arrived as an add or an update.
+* Not synchronized: the owner (a ConflatingListener, or a BoundedEdge under the CONFLATE policy) holds its own lock.
+* Type V is the data type, which must be copyable, and KeyOf maps a value to a small dense index.
+*/
+template<typename V, typename KeyOf = ProductIndexOf>
+class ConflationQueue
+{
+	static_assert(!IsStoreView<V>::value, "a conflation queue holds copies of its values, which a view does not own");
+
+public:
+
+	// A pending value and whether it was an update rather than an add
+	struct Event
+	{
+		V data;
+		bool isUpdate;
+	};
+
+	// Replace the pending value for _data's key, returning false if the key is not pending
+	bool Replace(const V& _data, bool _isUpdate)
+	{
+		size_t _key = KeyOf()(_data);
+		if (_key >= isPending.size() || !isPending[_key]) return false;
+		latest[_key] = Event{ _data, _isUpdate };
+		return true;
+	}
+
+	// Make _data's key pending with _data; the key must not be pending already
+	void Push(const V& _data, bool _isUpdate)
+	{
+		size_t _key = KeyOf()(_data);
+		if (_key >= latest.size())
+		{
+			latest.resize(_key + 1);
+			isPending.resize(_key + 1, false);
+		}
+		latest[_key] = Event{ _data, _isUpdate };
+		isPending[_key] = true;
+		pending.push_back(_key);
+	}
+
+	// Move the values of up to _count pending keys, oldest first, onto the end of _batch
+	void Take(vector<Event>& _batch, size_t _count)
+	{
+		while (!pending.empty() && _count-- > 0)
+		{
+			size_t _key = pending.front();
+			pending.pop_front();
+			_batch.push_back(latest[_key]);
+			isPending[_key] = false;
+		}
+	}
+
+	// Get the number of keys pending
+	size_t Size() const { return pending.size(); }
+
+	bool Empty() const { return pending.empty(); }
+
+private:
+
+	vector<Event> latest;    // latest value per key
+	vector<char> isPending;  // per key, whether it is in pending
+	deque<size_t> pending;   // keys with a value not yet taken, in arrival order
+
+};
+
+/**
+* Conflation stage insertable between two Services.
+* Registered as a listener on the upstream Service, it keeps only the latest value per key: a value
+* arriving for a key that is still pending replaces it. The downstream side calls Drain() (typically on
+* its own thread) to forward each pending key's latest value, in the order the keys first became pending,
+* as the add or update it arrived as. The producer never waits on the consumer and the backlog is bounded
+* by the number of keys.
+* Type V is the data type, which must be copyable, and KeyOf maps a value to a small dense index.
+*/
+template<typename V, typename KeyOf = ProductIndexOf>
+class ConflatingListener final : public ServiceListener<V>
+{
+
+public:
+
+	ConflatingListener() : closed(false), received(0), conflated(0), delivered(0) {}
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(V& _data) override { Offer(_data, false); }
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(V& _data) override {}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(V& _data) override { Offer(_data, true); }
+
+	// Forward the latest value of every pending key to _sink.ProcessAdd() or ProcessUpdate(), returning how many were forwarded
+	template<typename Sink>
+	size_t Drain(Sink& _sink)
+	{
+		{
+			lock_guard<mutex> _lock(guard);
+			TakePending();
+		}
+		return Deliver(_sink);
+	}
+
+	// Wait until a value is pending or the stage is closed, then Drain()
+	template<typename Sink>
+	size_t WaitAndDrain(Sink& _sink)
+	{
+		{
+			unique_lock<mutex> _lock(guard);
+			ready.wait(_lock, [&]() { return closed || !pending.Empty(); });
+			TakePending();
+		}
+		return Deliver(_sink);
+	}
+
+	// Mark the end of the stream: no more values will be added
+	void Close()
+	{
+		lock_guard<mutex> _lock(guard);
+		closed = true;
+		ready.notify_all();
+	}
+
+	// Whether the stream has been closed and every value forwarded
+	bool Drained()
+	{
+		lock_guard<mutex> _lock(guard);
+		return closed && pending.Empty();
+	}
+
+	// Get the number of values received, replaced while pending, and forwarded
+	long GetReceived() { lock_guard<mutex> _lock(guard); return received; }
+	long GetConflated() { lock_guard<mutex> _lock(guard); return conflated; }
+	long GetDelivered() { lock_guard<mutex> _lock(guard); return delivered; }
+
+	// Get the number of keys pending
+	size_t Pending() { lock_guard<mutex> _lock(guard); return pending.Size(); }
+
+private:
+
+	void Offer(const V& _data, bool _isUpdate)
+	{
+		lock_guard<mutex> _lock(guard);
+		received++;
+		if (pending.Replace(_data, _isUpdate))
+		{
+			conflated++;
+			return;
+		}
+		pending.Push(_data, _isUpdate);
+		if (pending.Size() == 1) ready.notify_one();
+	}
+
+	// Move the pending values into the batch; called with the lock held
+	void TakePending()
+	{
+		batch.clear();
+		pending.Take(batch, pending.Size());
+	}
+
+	// Forward the batch outside the lock
+	template<typename Sink>
+	size_t Deliver(Sink& _sink)
+	{
+		for (auto& _event : batch)
+		{
+			if (_event.isUpdate) _sink.ProcessUpdate(_event.data);
+			else _sink.ProcessAdd(_event.data);
+		}
+		lock_guard<mutex> _lock(guard);
+		delivered += batch.size();
+		return batch.size();
+	}
+
+	mutex guard;
+	condition_variable ready;
+	ConflationQueue<V, KeyOf> pending;                      // latest value per pending key
+	vector<typename ConflationQueue<V, KeyOf>::Event> batch; // values being forwarded, owned by the draining thread
+	bool closed;
+	long received;
+	long conflated;
+	long delivered;
+
+};
+
 /**
 * Definition of a Connector class.
 * This will invoke the Service.OnMessage() method for subscriber Connectors
@@ -0,0 +1,121 @@
+/**
+* spscqueue.hpp
+* Defines a bounded lock-free single-producer/single-consumer ring used to hand events between threads,
+* and a ServiceListener that publishes into one.
+*
+*/
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "soa.hpp"
+
+using namespace std;
+
+// Size of a cache line, used to keep producer and consumer indices apart
+const size_t CACHE_LINE_SIZE = 64;
+
+/**
+* Bounded ring with exactly one producer thread and one consumer thread.
+* Capacity is rounded up to a power of two. Each side caches the other's index so the
+* shared atomics are only read when the ring looks full (producer) or empty (consumer).
+* Type E is the element type.
+*/
+template<typename E>
+class SPSCQueue{
+public:
+	// ctor for a queue holding at least _capacity elements
+	explicit SPSCQueue(size_t _capacity){
+        size_t _size = 1;
+        while (_size < _capacity) _size <<= 1;
+        slots = vector<E>(_size);
+        mask = _size - 1;
+        head.store(0, memory_order_relaxed);
+        tail.store(0, memory_order_relaxed);
+        closed.store(false, memory_order_relaxed);
+        headCache = 0;
+        tailCache = 0;
+    }
+	SPSCQueue(const SPSCQueue&) = delete;
+	SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+	// Push an element if there is room (producer only)
+	bool TryPush(const E& _element){
+        size_t _tail = tail.load(memory_order_relaxed);
+        if (_tail - headCache > mask){
+            headCache = head.load(memory_order_acquire);
+            if (_tail - headCache > mask) return false;
+        }
+        slots[_tail & mask] = _element;
+        tail.store(_tail + 1, memory_order_release);
+        return true;
+    }
+	// Push an element, waiting while the ring is full (producer only)
+	void Push(const E& _element){
+        while (!TryPush(_element)) this_thread::yield();
+    }
+	// Pop an element if there is one (consumer only)
+	bool TryPop(E& _element){
+        size_t _head = head.load(memory_order_relaxed);
+        if (_head == tailCache){
+            tailCache = tail.load(memory_order_acquire);
+            if (_head == tailCache) return false;
+        }
+        _element = std::move(slots[_head & mask]);
+        head.store(_head + 1, memory_order_release);
+        return true;
+    }
+	// Mark that no more elements will be pushed (producer only)
+	void Close(){
+        closed.store(true, memory_order_release);
+    }
+	// Whether the producer has closed the ring and every element has been popped (consumer only)
+	bool Drained() const{
+        return closed.load(memory_order_acquire) && head.load(memory_order_relaxed) == tail.load(memory_order_acquire);
+    }
+	// Get the number of elements currently queued
+	size_t Size() const{
+        return tail.load(memory_order_acquire) - head.load(memory_order_acquire);
+    }
+	// Get the capacity of the ring
+	size_t Capacity() const{
+        return mask + 1;
+    }
+private:
+	vector<E> slots;
+	size_t mask;
+	alignas(CACHE_LINE_SIZE) atomic<size_t> head;   // next slot to pop, written by the consumer
+	size_t tailCache;                               // consumer's copy of tail
+	alignas(CACHE_LINE_SIZE) atomic<size_t> tail;   // next slot to push, written by the producer
+	size_t headCache;                               // producer's copy of head
+	alignas(CACHE_LINE_SIZE) atomic<bool> closed;
+};
+
+/**
+* Listener handing every added event to another thread through an SPSCQueue.
+* It must only be called from the queue's producer thread, and V must own its data (not a store view such as Position).
+* Type V is the data type.
+*/
+template<typename V>
+class QueueListener final : public ServiceListener<V>{
+	static_assert(!IsStoreView<V>::value, "a queued event is read on another thread, which a view does not own");
+private:
+	SPSCQueue<V>& queue;
+public:
+	// ctor and dtor
+	explicit QueueListener(SPSCQueue<V>& _queue) : queue(_queue){}
+	~QueueListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(V& _data) override{
+        queue.Push(_data);
+    }
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(V& _data) override{}
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(V& _data) override{}
+};
+
+#endif
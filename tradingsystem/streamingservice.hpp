@@ -10,6 +10,7 @@
 #define STREAMING_SERVICE_HPP
 
 #include "soa.hpp"
+#include "logger.hpp"
 #include "algostreamingservice.hpp"
 
 template<typename T>
@@ -25,14 +26,13 @@ class StreamingServiceConnector;
 template<typename T>
 class StreamingService : public Service<string, PriceStream<T>> {
 private:
-    map<string, PriceStream<T>> priceStreams;
+    ProductTable<T, PriceStream<T>> priceStreams;
     vector<ServiceListener<PriceStream<T>>*> listeners;
-    ServiceListener<AlgoStream<T>>* listener;
+    StreamingListenerFromAlgoStreaming<T>* listener;
     StreamingServiceConnector<T>* connector;
 
 public:
     StreamingService() {
-        priceStreams = map<string, PriceStream<T>>();
         listeners = vector<ServiceListener<PriceStream<T>>*>();
         listener = new StreamingListenerFromAlgoStreaming<T>(this);
         connector = new StreamingServiceConnector<T>(this);
@@ -40,11 +40,11 @@ public:
     ~StreamingService() = default;
     // Get data on our service given a key
     PriceStream<T>& GetData(string _key) {
-        return priceStreams[_key];
+        return priceStreams.At(_key);
     }
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(PriceStream<T>& _data) {
-        priceStreams[_data.GetProduct().GetProductId()] = _data;
+        priceStreams[_data.GetProductHandle()] = _data;
     }
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
     void AddListener(ServiceListener<PriceStream<T>>* _listener) {
@@ -55,15 +55,19 @@ public:
         return listeners;
     }
     // Get the listener of the service
-    ServiceListener<AlgoStream<T>>* GetListener() {
+    StreamingListenerFromAlgoStreaming<T>* GetListener() {
         return listener;
     }
     // Publish two-way prices
     void PublishPrice(PriceStream<T>& _priceStream) {
+        VirtualListeners<PriceStream<T>> _sink(listeners);
+        PublishPrice(_priceStream, _sink);
+    }
+    // Publish two-way prices to a compile-time sink
+    template<typename Sink>
+    void PublishPrice(PriceStream<T>& _priceStream, Sink& _sink) {
         connector->Publish(_priceStream);
-        for (auto& l : listeners) {
-            l->ProcessAdd(_priceStream);
-        }
+        _sink.ProcessAdd(_priceStream);
     }
 };
 
@@ -81,16 +85,29 @@ public:
     void Publish(PriceStream<T>& data)override
     {
         // Print the price stream data
-        T product = data.GetProduct();
-        string productId = product.GetProductId();
-        PriceStreamOrder bid = data.GetBidOrder();
-        PriceStreamOrder offer = data.GetOfferOrder();
+        const string& productId = data.GetProduct().GetProductId();
+        const PriceStreamOrder& bid = data.GetBidOrder();
+        const PriceStreamOrder& offer = data.GetOfferOrder();
 
-        cout << "Price Stream " << "(Product " << productId << "): \n"
-             << "\tBid\t" << "Price: " << bid.GetPrice() << "\tVisibleQuantity: " << bid.GetVisibleQuantity()
-             << "\tHiddenQuantity: " << bid.GetHiddenQuantity() << "\n"
-             << "\tAsk\t" << "Price: " << offer.GetPrice() << "\tVisibleQuantity: " << offer.GetVisibleQuantity()
-             << "\tHiddenQuantity: " << offer.GetHiddenQuantity() << "\n";
+        // formatted into a reused buffer and written out by the logger thread
+        thread_local RecordBuffer _text;
+        _text.Clear();
+        _text.Append("Price Stream (Product ");
+        _text.Append(productId);
+        _text.Append("): \n\tBid\tPrice: ");
+        _text.AppendNumber(bid.GetPrice());
+        _text.Append("\tVisibleQuantity: ");
+        _text.AppendInteger(bid.GetVisibleQuantity());
+        _text.Append("\tHiddenQuantity: ");
+        _text.AppendInteger(bid.GetHiddenQuantity());
+        _text.Append("\n\tAsk\tPrice: ");
+        _text.AppendNumber(offer.GetPrice());
+        _text.Append("\tVisibleQuantity: ");
+        _text.AppendInteger(offer.GetVisibleQuantity());
+        _text.Append("\tHiddenQuantity: ");
+        _text.AppendInteger(offer.GetHiddenQuantity());
+        _text.Append("\n");
+        Logger::Instance().Write(_text.View());
     }
     void Subscribe(ifstream& _data) override {}
 };
@@ -101,7 +118,7 @@ public:
 * Type T is the product type.
 */
 template<typename T>
-class StreamingListenerFromAlgoStreaming : public ServiceListener<AlgoStream<T>> {
+class StreamingListenerFromAlgoStreaming final : public ServiceListener<AlgoStream<T>> {
 private:
     StreamingService<T>* service;
 public:
@@ -111,9 +128,15 @@ public:
     ~StreamingListenerFromAlgoStreaming() = default;
     // Listener callback to process an add event to the Service
     void ProcessAdd(AlgoStream<T>& _data) {
+        VirtualListeners<PriceStream<T>> _sink(service->GetListeners());
+        ProcessAdd(_data, _sink);
+    }
+    // Listener callback to process an add event, publishing to a compile-time sink
+    template<typename Sink>
+    void ProcessAdd(AlgoStream<T>& _data, Sink& _sink) {
         PriceStream<T>* _priceStream = _data.GetPriceStream();
         service->OnMessage(*_priceStream);
-        service->PublishPrice(*_priceStream);
+        service->PublishPrice(*_priceStream, _sink);
     }
     // Listener callback to process a remove event to the Service
     void ProcessRemove(AlgoStream<T>& _data) {
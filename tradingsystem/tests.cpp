@@ -0,0 +1,226 @@
+/**
+* tests.cpp
+* Regression tests for the trading system, run by ctest. Each test prints what it checked and
+* the process exits non-zero if any check failed.
+*
+*/
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <filesystem>
+#include <unistd.h>
+
+#include "soa.hpp"
+#include "products.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "historicaldataservice.hpp"
+#include "algoexecutionservice.hpp"
+
+using namespace std;
+
+// Checks failed so far
+int failures = 0;
+
+// Record a check, printing it if it failed
+void Check(bool _passed, const string& _what)
+{
+	if (_passed) return;
+	cout << "FAILED: " << _what << endl;
+	failures++;
+}
+
+// Format a number with enough digits to tell it from 0
+string Text(double _value)
+{
+	ostringstream _text;
+	_text << _value;
+	return _text.str();
+}
+
+// Positions are views on their store, so edges and queues refuse them; events that own their data pass
+static_assert(IsStoreView<Position<Bond>>::value, "a position is a view on its store");
+static_assert(!IsStoreView<Trade<Bond>>::value, "a trade owns its data");
+
+// Opening positions across a sector's products and books and closing them again, in another order and
+// with a curve shift in between, brings the sector's running total back to exactly 0.
+void TestBucketedRiskReturnsToZero()
+{
+	RiskService<Bond> _risk;
+	PositionStore<Bond> _store;
+	vector<Bond> _bonds = { GetBond("912828M80"), GetBond("9128283J7"), GetBond("9128283F5") };
+	size_t _id = _risk.RegisterSector(BucketedSector<Bond>(_bonds, "Belly"));
+	vector<string> _books = { "TRSY1", "TRSY2", "TRSY3" };
+	vector<long> _quantities = { 1000000, 2000000, 3000000, 4000000, 5000000, 7000000, 9000000 };
+
+	vector<Position<Bond>> _positions;
+	for (auto& b : _bonds) _positions.push_back(Position<Bond>(ProductHandle<Bond>(b), _store));
+	auto _book = [&](size_t _trade, long _sign) {
+		Position<Bond>& _position = _positions[_trade % _positions.size()];
+		_position.AddPosition(_books[_trade % _books.size()], _sign * _quantities[_trade % _quantities.size()]);
+		_risk.AddPosition(_position);
+	};
+	const size_t _trades = 500;
+	for (size_t t = 0; t < _trades; ++t) _book(t, 1);
+	Check(_risk.GetBucketedRisk(_id).GetPV01() != 0.0, "open sector has risk");
+	_risk.OnCurveShift(0.0001);
+	for (size_t t = _trades; t-- > 0;) _book(t, -1);
+	Check(_risk.GetBucketedRisk(_id).GetPV01() == 0.0, "flat sector after a curve shift has exactly 0 risk, got "
+		+ Text(_risk.GetBucketedRisk(_id).GetPV01()));
+
+	for (size_t t = 0; t < _trades; ++t) _book(t * 7, 1);
+	for (size_t t = 0; t < _trades; ++t) _book(t * 7, -1);
+	Check(_risk.GetBucketedRisk(_id).GetPV01() == 0.0, "flat sector has exactly 0 risk, got "
+		+ Text(_risk.GetBucketedRisk(_id).GetPV01()));
+	cout << "bucketed risk returns to 0" << endl;
+}
+
+// Every position risked reaches the historical risk service, which writes one risk.txt line per PV01 it is added.
+void TestRiskIsPersisted()
+{
+	filesystem::path _directory = filesystem::temp_directory_path() / ("tradingsystem_tests_risk_" + to_string(getpid()));
+	filesystem::create_directories(_directory);
+	filesystem::path _cwd = filesystem::current_path();
+	filesystem::current_path(_directory);
+	const long _trades = 10;
+	{
+		RiskService<Bond> _risk;
+		HistoricalDataService<PV01<Bond>> _historical(RISK);
+		_risk.AddListener(_historical.GetListener());
+		PositionStore<Bond> _store;
+		Position<Bond> _position(ProductHandle<Bond>(GetBond("912828M80")), _store);
+		for (long t = 0; t < _trades; ++t)
+		{
+			_position.AddPosition("TRSY1", 1000000);
+			_risk.AddPosition(_position);
+		}
+	}
+	ifstream _file("risk.txt");
+	long _lines = 0;
+	for (string _line; getline(_file, _line);) ++_lines;
+	Check(_lines == _trades, "risk.txt has a line per position risked, got " + to_string(_lines));
+	filesystem::current_path(_cwd);
+	filesystem::remove_all(_directory);
+	cout << "risk is persisted" << endl;
+}
+
+// Counts the events a service publishes
+template<typename V>
+class CountingListener final : public ServiceListener<V>
+{
+public:
+	void ProcessAdd(V& _data) override { adds++; }
+	void ProcessRemove(V& _data) override {}
+	void ProcessUpdate(V& _data) override { adds++; }
+	long adds = 0;
+};
+
+// A book with a side emptied sends no execution, while a tight two-way book still does.
+void TestOneSidedBookIsNotExecuted()
+{
+	AlgoExecutionService<Bond> _algo;
+	CountingListener<AlgoExecution<Bond>> _executions;
+	_algo.AddListener(&_executions);
+	ProductHandle<Bond> _product(GetBond("912828M80"));
+	OrderBook<Bond> _bidsOnly(_product, { Order(99.5, 1000000, BID) }, {});
+	OrderBook<Bond> _offersOnly(_product, {}, { Order(99.5, 1000000, OFFER) });
+	_algo.AlgoExecuteOrder(_bidsOnly);
+	_algo.AlgoExecuteOrder(_offersOnly);
+	Check(_executions.adds == 0, "a one-sided book sends no execution, got " + to_string(_executions.adds));
+	OrderBook<Bond> _twoSided(_product, { Order(99.5, 1000000, BID) }, { Order(99.5 + 1.0 / 256, 1000000, OFFER) });
+	_algo.AlgoExecuteOrder(_twoSided);
+	Check(_executions.adds == 1, "a two-way book within the spread is executed");
+	cout << "one-sided books are not executed" << endl;
+}
+
+// Reading a ProductTable, directly or through a service's read paths, stores nothing; only writing does.
+void TestReadsDoNotInsert()
+{
+	const string _productId = "912828M80";
+	size_t _index = ProductRegistry<Bond>::Instance().Find(_productId);
+	ProductTable<Bond, long> _table;
+	Check(_table.Find(_index) == nullptr && _table.Find(_productId) == nullptr, "an empty table finds nothing");
+	bool _threw = false;
+	try { _table.At(_productId); }
+	catch (const out_of_range&) { _threw = true; }
+	Check(_threw && !_table.Contains(_index), "At() on an empty table throws and stores nothing");
+	_table[_index] = 7;
+	Check(_table.Contains(_index) && _table.At(_productId) == 7, "a written value is stored");
+
+	MarketDataService<Bond> _marketData;
+	BidOffer _bidOffer = _marketData.GetBestBidOffer(_productId);
+	Check(_bidOffer.GetBidOrder().GetQuantity() == 0 && _bidOffer.GetOfferOrder().GetQuantity() == 0, "a product with no book has an empty best bid/offer");
+	_threw = false;
+	try { _marketData.GetData(_productId); }
+	catch (const out_of_range&) { _threw = true; }
+	Check(_threw, "GetBestBidOffer() does not add a book");
+	cout << "reads do not insert" << endl;
+}
+
+// Records of one output file by product, in file order, without the timestamp and with generated ids masked.
+// _productField and _idField count the fields after the timestamp; _idField is -1 if the records carry no generated id.
+map<string, vector<string>> RecordsByProduct(const string& _path, int _productField, int _idField)
+{
+	map<string, vector<string>> _records;
+	ifstream _file(_path);
+	string _line;
+	while (getline(_file, _line))
+	{
+		vector<string> _fields;
+		stringstream _stream(_line.substr(_line.find(',') + 1));
+		string _field;
+		while (getline(_stream, _field, ',')) _fields.push_back(_field);
+		if (_idField >= 0 && _idField < static_cast<int>(_fields.size())) _fields[_idField] = "ID";
+		string _record;
+		for (auto& f : _fields) _record += f + ",";
+		_records[_fields.size() > size_t(_productField) ? _fields[_productField] : ""].push_back(_record);
+	}
+	return _records;
+}
+
+// The sharded graph, fed one file at a time, writes the same records per product as the sequential single graph.
+// Runs _binary on the files in _data in two scratch directories and compares what each run persisted.
+void TestShardedMatchesSequential(const string& _binary, const string& _data)
+{
+	filesystem::path _scratch = filesystem::temp_directory_path() / ("tradingsystem_tests_" + to_string(getpid()));
+	auto _run = [&](const string& _name, const string& _options) {
+		filesystem::path _directory = _scratch / _name;
+		filesystem::create_directories(_directory);
+		string _command = "cd '" + _directory.string() + "' && '" + _binary + "' --data '" + _data + "' --session 0 " + _options + " > /dev/null";
+		Check(system(_command.c_str()) == 0, "run " + _options);
+		return _directory;
+	};
+	filesystem::path _sequential = _run("sequential", "--sequential");
+	filesystem::path _sharded = _run("sharded", "--sequential --shards 3");
+
+	struct Output { string file; int productField; int idField; };
+	for (const Output& o : { Output{ "positions.txt", 0, -1 }, Output{ "risk.txt", 0, -1 }, Output{ "executions.txt", 0, 2 },
+	                         Output{ "streaming.txt", 0, -1 }, Output{ "allinquiries.txt", 1, -1 } })
+	{
+		map<string, vector<string>> _expected = RecordsByProduct((_sequential / o.file).string(), o.productField, o.idField);
+		map<string, vector<string>> _actual = RecordsByProduct((_sharded / o.file).string(), o.productField, o.idField);
+		// two empty files would compare equal without checking anything
+		Check(!_expected.empty() && !_actual.empty(), o.file + " has records in both runs");
+		Check(_actual == _expected, o.file + " matches per product between the sequential and the sharded run");
+	}
+	filesystem::remove_all(_scratch);
+	cout << "sharded output matches sequential" << endl;
+}
+
+// With the tradingsystem binary and the data directory as arguments, also runs the tests driving the executable.
+int main(int argc, char* argv[])
+{
+	// a single scratch session, so its order ids never meet another run's
+	IdGenerator::Instance().SetSession(0);
+	TestBucketedRiskReturnsToZero();
+	TestRiskIsPersisted();
+	TestOneSidedBookIsNotExecuted();
+	TestReadsDoNotInsert();
+	if (argc >= 3) TestShardedMatchesSequential(argv[1], argv[2]);
+	cout << (failures == 0 ? "all tests passed" : to_string(failures) + " checks failed") << endl;
+	return failures == 0 ? 0 : 1;
+}
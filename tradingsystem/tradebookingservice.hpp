@@ -15,10 +15,19 @@
 #include "executionservice.hpp"
 #include "products.hpp"
 #include "functions.hpp"
+#include "parallelloader.hpp"
 
 // Trade sides
 enum Side { BUY, SELL };
 
+// Parse a trade side; throws invalid_argument unless the field is BUY or SELL.
+Side ParseSide(string_view _field)
+{
+	if (_field == "BUY") return BUY;
+	if (_field == "SELL") return SELL;
+	throw invalid_argument("Invalid side " + string(_field));
+}
+
 /**
 * Trade object with a price, side, and quantity on a particular book.
 * Type T is the product type.
@@ -29,7 +38,8 @@ public:
 
 	// ctor for a trade
 	Trade() = default;
-	Trade(const T& _product, string _tradeId, double _price, string _book, long _quantity, Side _side){
+	Trade(ProductHandle<T> _product, string _tradeId, double _price, string _book, long _quantity, Side _side){
+        product = _product;
         tradeId = _tradeId;
         price = _price;
         book = _book;
@@ -39,6 +49,9 @@ public:
 
 	// Get the product
 	const T& GetProduct() const{
+        return product.Get();}
+	// Get the handle onto the registered product
+	ProductHandle<T> GetProductHandle() const{
         return product;}
 	// Get the trade ID
 	const string& GetTradeId() const{
@@ -56,7 +69,7 @@ public:
 	Side GetSide() const{
         return side;}
 private:
-	T product;
+	ProductHandle<T> product;
 	string tradeId;
 	double price;
 	string book;
@@ -148,28 +161,41 @@ public:
 
     // Subscribe data from the Connector
     void Subscribe(ifstream& _data) {
+        ServiceSink<string, Trade<T>> _sink(*service);
+        Subscribe(_data, _sink);
+    }
+    // Subscribe data from the Connector, handing each trade to _sink instead of the service
+    // (e.g. a QueueListener feeding the thread that owns the service); each line is parsed with ParseLine() as the parallel loaders do
+    template<typename Sink>
+    void Subscribe(ifstream& _data, Sink& _sink) {
         string _line;
+        vector<Trade<T>> _trades;
         while (getline(_data, _line)) {
-            stringstream _lineStream(_line);
-            string _cell;
-            vector<string> _cells;
-
-            // Efficiently reserve space for the expected number of cells
-            _cells.reserve(6);  // Assuming 6 fields per line
-
-            while (getline(_lineStream, _cell, ',')) {
-                _cells.push_back(std::move(_cell));  // Use move semantics to avoid copying strings
-            }
-
-            // Directly process the data without intermediate variables where possible
-            Side _side = (_cells[5] == "BUY") ? BUY : SELL;
-            T _product = GetBond(_cells[0]);
-
-            // Create and process the trade
-            Trade<T> _trade(_product, _cells[1], ConvertPrice(_cells[2]), _cells[3], stol(_cells[4]), _side);
-            service->OnMessage(_trade);
+            if (_line.empty()) continue;
+            _trades.clear();
+            ParseLine(_line, _trades);
+            for (auto& t : _trades) _sink.ProcessAdd(t);
         }
     }
+    // Subscribe data from a file parsed on _threads threads (one per core if 0), delivering trades in file order
+    void SubscribeParallel(const string& _path, size_t _threads = 0) {
+        ServiceSink<string, Trade<T>> _sink(*service);
+        SubscribeParallel(_path, _sink, _threads);
+    }
+    template<typename Sink>
+    void SubscribeParallel(const string& _path, Sink& _sink, size_t _threads = 0) {
+        ParallelLoader<Trade<T>>(_threads).Load(_path, &TradeBookingConnector::ParseLine, [&](Trade<T>& _trade) { _sink.ProcessAdd(_trade); });
+    }
+    // Parse a "product,trade id,price,book,quantity,side" line in place
+    static void ParseLine(string_view _line, vector<Trade<T>>& _trades) {
+        ProductHandle<T> _product = GetProductHandle<T>(NextToken(_line, ','));
+        string _tradeId(NextToken(_line, ','));
+        double _price = ConvertPrice(NextToken(_line, ','));
+        string _book(NextToken(_line, ','));
+        long _quantity = ParseLong(NextToken(_line, ','));
+        Side _side = ParseSide(NextToken(_line, ','));
+        _trades.push_back(Trade<T>(_product, _tradeId, _price, _book, _quantity, _side));
+    }
 };
 
 /**
@@ -181,31 +207,30 @@ class TradeBookingListenerFromExecution : public ServiceListener<ExecutionOrder<
 {
 private:
 	TradeBookingService<T>* service;
-	long count;
+	ProductTable<T, long> counts; // product index -> executions booked, which rotates the book
 public:
 	// Connector and Destructor
 	TradeBookingListenerFromExecution(TradeBookingService<T>* _service){
-        service = _service;
-        count = 0;}
+        service = _service;}
 	~TradeBookingListenerFromExecution() = default;
 	// Listener callback to process an add event to the Service
     // Listener callback to process an add event to the Service
     void ProcessAdd(ExecutionOrder<T>& _data) override {
-        // Increment the trade count
-        count++;
+        // Increment the product's trade count
+        long _count = ++counts[_data.GetProductHandle()];
 
         // Simplify the conversion from PricingSide to Side
         Side _side = (_data.GetPricingSide() == BID) ? SELL : BUY;
 
         // Determine the book based on the current count
         static const vector<string> books = {"TRSY1", "TRSY2", "TRSY3"};
-        string _book = books[count % books.size()];
+        string _book = books[_count % books.size()];
 
         // Calculate total quantity
         long _quantity = _data.GetVisibleQuantity() + _data.GetHiddenQuantity();
 
         // Create and process the trade
-        Trade<T> _trade(_data.GetProduct(), _data.GetOrderId(), _data.GetPrice(), _book, _quantity, _side);
+        Trade<T> _trade(_data.GetProductHandle(), _data.GetOrderId(), _data.GetPrice(), _book, _quantity, _side);
         service->OnMessage(_trade);
     }
 